@@ -13,259 +13,6315 @@
 
 #include <DynRPG/DynRPG.h>
 #define NOT_MAIN_MODULE
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined( __i386__ ) || defined( __x86_64__ )
+#include <cpuid.h>
+#endif
+#ifdef DYNGAUGE_FIXED_LAYOUT
+#include "DynGaugeLayout.h"
+#endif
 
-//! Battle display for a single Battler
+//! Callback of a Timer
 /*!
-    This class handles the modeling and displaying of battle information for a single Battler (hero
-    or monster) including gauges for health, mana, and ATB, plus
+    A TimerCallback is called when its Timer expires, with the context pointer given when the
+    Timer was set up.
 */
-class BattleDisplay
+typedef void (* TimerCallback)( void * rContextPtr );
+
+//! Timer for a time-based display effect
+/*!
+    A Timer is owned by the object whose effect it drives (usually as a member) and is linked into
+    a TimerWheel while it is scheduled, so scheduling never allocates memory.
+*/
+class Timer
 {
 
 public:
 
-    const static int DISPLAY_WIDTH = 80;                //!< Width of the display Image (TODO: probably will change this, currently set to more than it needs to be for experimental purposes)
-    const static int DISPLAY_HEIGHT = 320;              //!< Height of the display Image (TODO: probably will change this, currently set to more than it needs to be for experimental purposes)
-    const static int IMAGE_UNIT_SIZE = 8;               //!< Unit size for Images (smallest possible width/height for an Image)
-    const static int GAUGE_WIDTH = 40;                  //!< Width of a gauge Image
-    const static int GAUGE_HEIGHT = 8;                  //!< Height of a gauge Image
-    const static int HEALTH_GAUGE_SRC_X = 0;            //!< Source X coordinate of health gauge in SystemGraphic
-    const static int HEALTH_GAUGE_SRC_Y = 40;           //!< Source Y coordinate of health gauge in SystemGraphic
-    const static int MANA_GAUGE_SRC_X = 0;              //!< Source X coordinate of mana gauge in SystemGraphic
-    const static int MANA_GAUGE_SRC_Y = 56;             //!< Source Y coordinate of mana gauge in SystemGraphic
-    const static int ATB_GAUGE_SRC_X = 0;               //!< Source X coordinate of ATB gauge in SystemGraphic
-    const static int ATB_GAUGE_SRC_Y = 72;              //!< Source Y coordinate of ATB gauge in SystemGraphic
-    const static int BAR_WIDTH = 40;                    //!< Width of a bar Image
-    const static int BAR_HEIGHT = 8;                    //!< Height of a bar Image
-    const static int HEALTH_BAR_A_SRC_X = 48;           //!< Source X coordinate of health bar A in SystemGraphic
-    const static int HEALTH_BAR_A_SRC_Y = 40;           //!< Source Y coordinate of health bar A in SystemGraphic
-    const static int MANA_BAR_A_SRC_X = 48;             //!< Source X coordinate of mana bar A in SystemGraphic
-    const static int MANA_BAR_A_SRC_Y = 56;             //!< Source Y coordinate of mana bar A in SystemGraphic
-    const static int ATB_BAR_A_SRC_X = 48;              //!< Source X coordinate of ATB bar A in SystemGraphic
-    const static int ATB_BAR_A_SRC_Y = 72;              //!< Source Y coordinate of ATB bar A in SystemGraphic
-    const static int HEALTH_BAR_B_SRC_X = 64;           //!< Source X coordinate of health bar B in SystemGraphic
-    const static int HEALTH_BAR_B_SRC_Y = 40;           //!< Source Y coordinate of health bar B in SystemGraphic
-    const static int MANA_BAR_B_SRC_X = 64;             //!< Source X coordinate of mana bar B in SystemGraphic
-    const static int MANA_BAR_B_SRC_Y = 56;             //!< Source Y coordinate of mana bar B in SystemGraphic
-    const static int ATB_BAR_B_SRC_X = 64;              //!< Source X coordinate of ATB bar B in SystemGraphic
-    const static int ATB_BAR_B_SRC_Y = 72;              //!< Source Y coordinate of ATB bar B in SystemGraphic
-    const static int DIGIT_WIDTH = 8;                   //!< Width of a digit Image
-    const static int DIGIT_HEIGHT = 16;                 //!< Height of a digit Image
-    const static int DIGIT_SRC_X = 0;                   //!< Source X coordinate of the first digit in SystemGraphic
-    const static int DIGIT_SRC_Y = 80;                  //!< Source Y coordinate of the first digit in SystemGraphic
-    const static int NUM_DIGITS = 10;                   //!< Amount of digit Images
+    //! Constructor
+    /*!
+        This constructor creates an unscheduled Timer with the given callback.
 
-    static RPG::Image * mHealthGaugePtr;                //!< Pointer to an Image of the health gauge
-    static RPG::Image * mManaGaugePtr;                  //!< Pointer to an Image of the mana gauge
-    static RPG::Image * mATBGaugePtr;                   //!< Pointer to an Image of the ATB gauge
-    static RPG::Image * mHealthBarAPtr;                 //!< Pointer to an Image of health bar A ("non-full")
-    static RPG::Image * mHealthBarBPtr;                 //!< Pointer to an Image of health bar B ("full")
-    static RPG::Image * mManaBarAPtr;                   //!< Pointer to an Image of mana bar A ("non-full")
-    static RPG::Image * mManaBarBPtr;                   //!< Pointer to an Image of mana bar B ("full")
-    static RPG::Image * mATBBarAPtr;                    //!< Pointer to an Image of ATB bar A ("non-full")
-    static RPG::Image * mATBBarBPtr;                    //!< Pointer to an Image of ATB bar B ("full")
-    static RPG::Image * mDigitPtr[NUM_DIGITS];          //!< Array of pointers to Image of numerical digits 0-9
+        \param rCallback : (TimerCallback) Function to call when the Timer expires
+        \param rContextPtr : (void *) Pointer passed to the callback
+    */
+    Timer( TimerCallback rCallback = NULL, void * rContextPtr = NULL )
+    {
+
+        mCallback = rCallback;
+        mContextPtr = rContextPtr;
+        mExpiry = 0;
+        mLevel = -1;
+        mSlot = -1;
+        mNextPtr = NULL;
+        mPrevPtr = NULL;
+
+    }
+
+    //! Sets the callback
+    /*!
+        SetCallback() sets the function to call when the Timer expires and its context pointer.
+
+        \param rCallback : (TimerCallback) Function to call when the Timer expires
+        \param rContextPtr : (void *) Pointer passed to the callback
+    */
+    void SetCallback( TimerCallback rCallback, void * rContextPtr )
+    {
+
+        mCallback = rCallback;
+        mContextPtr = rContextPtr;
+
+    }
+
+    //! Checks whether the Timer is scheduled
+    /*!
+        \return (bool) true if the Timer is waiting in a TimerWheel
+    */
+    bool IsScheduled()
+    {
+
+        return -1 != mLevel;
+
+    }
+
+private:
+
+    friend class TimerWheel;
+
+    TimerCallback mCallback;                            //!< Function to call when the Timer expires
+    void * mContextPtr;                                 //!< Pointer passed to the callback
+    int mExpiry;                                        //!< Frame at which the Timer expires
+    int mLevel;                                         //!< Level of the TimerWheel the Timer is in (-1 = not scheduled)
+    int mSlot;                                          //!< Slot within the level the Timer is in
+    Timer * mNextPtr;                                   //!< Pointer to the next Timer in the same slot
+    Timer * mPrevPtr;                                   //!< Pointer to the previous Timer in the same slot
+
+};
+
+//! Hierarchical timer wheel
+/*!
+    This class schedules Timers by frame. Level 0 has one slot per frame for the next 64 frames;
+    each higher level has slots 64 times as wide, and when the lower level wraps around, the
+    current slot of the next level is cascaded down. Scheduling and cancelling are O(1), and the
+    cost of Advance() is proportional to the number of Timers expiring (or cascading) on that
+    frame, not to the number of Timers waiting.
+*/
+class TimerWheel
+{
+
+public:
+
+    const static int SLOT_BITS = 6;                     //!< Number of bits of the frame number covered by one level
+    const static int NUM_SLOTS = 1 << SLOT_BITS;        //!< Number of slots per level
+    const static int SLOT_MASK = NUM_SLOTS - 1;         //!< Mask for the slot index within a level
+    const static int NUM_LEVELS = 3;                    //!< Number of levels
+    const static int MAX_DELAY = ( 1 << ( SLOT_BITS * NUM_LEVELS ) ) - 1;  //!< Longest possible delay in frames (longer delays are clamped)
 
     //! Default constructor
     /*!
-        The default constructor of BattleDisplay provides an empty instance.
+        The default constructor of TimerWheel provides an empty wheel at frame 0.
     */
-    BattleDisplay()
+    TimerWheel()
     {
 
-        // Initialize variables
-        mBattlerPtr = NULL;
-        mCurHealth = 0;
-        mCurMana = 0;
-        mCurATB = 0;
-        mDisplayPtr = RPG::Image::create( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+        int i;          // Index variable
+
+        mNow = 0;
+        for( i = 0; i < NUM_LEVELS * NUM_SLOTS; i++ )
+        {
+
+            mSlots[i] = NULL;
+
+        }
 
     }
 
-    //! Constructor
+    //! Gets the current frame
     /*!
-        This constructor creates a BattleDisplay for a given Battler.
+        \return (int) Number of times Advance() has been called
+    */
+    int Now()
+    {
 
-        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler which this BattleDisplay will serve
+        return mNow;
+
+    }
+
+    //! Schedules a Timer
+    /*!
+        Schedule() makes a Timer expire the given number of frames from now, cancelling it first
+        if it was already scheduled.
+
+        \param rTimer : (Timer &) Timer to schedule
+        \param rDelay : (int) Number of frames until the Timer expires (at least 1)
     */
-    BattleDisplay( RPG::Battler * rBattlerPtr )
+    void Schedule( Timer & rTimer, int rDelay )
+    {
+
+        Cancel( rTimer );
+        if( rDelay < 1 )
+        {
+
+            rDelay = 1;
+
+        }
+        if( rDelay > MAX_DELAY )
+        {
+
+            rDelay = MAX_DELAY;
+
+        }
+        rTimer.mExpiry = mNow + rDelay;
+        Insert( rTimer );
+
+    }
+
+    //! Cancels a Timer
+    /*!
+        Cancel() removes a Timer from the wheel, if it is scheduled.
+
+        \param rTimer : (Timer &) Timer to cancel
+    */
+    void Cancel( Timer & rTimer )
+    {
+
+        Timer ** headPtr;       // Pointer to the head of the Timer's slot
+
+        if( !rTimer.IsScheduled() )
+        {
+
+            return;
+
+        }
+        headPtr = &mSlots[rTimer.mLevel * NUM_SLOTS + rTimer.mSlot];
+        if( NULL != rTimer.mPrevPtr )
+        {
+
+            rTimer.mPrevPtr->mNextPtr = rTimer.mNextPtr;
+
+        }
+        else
+        {
+
+            *headPtr = rTimer.mNextPtr;
+
+        }
+        if( NULL != rTimer.mNextPtr )
+        {
+
+            rTimer.mNextPtr->mPrevPtr = rTimer.mPrevPtr;
+
+        }
+        rTimer.mNextPtr = NULL;
+        rTimer.mPrevPtr = NULL;
+        rTimer.mLevel = -1;
+        rTimer.mSlot = -1;
+
+    }
+
+    //! Advances the wheel by one frame
+    /*!
+        Advance() moves to the next frame, cascading higher levels down when a lower level wraps
+        around, and calls the callbacks of all Timers which expire on the new frame. A callback
+        may schedule its own Timer again.
+    */
+    void Advance()
+    {
+
+        int level;              // Index variable
+        Timer * timerPtr;       // Timer which is expiring
+
+        mNow++;
+        // Find the highest level whose current slot starts at this frame, and cascade from there
+        // down, so Timers from higher levels can land in the slots cascaded after them
+        level = 0;
+        while( level < NUM_LEVELS - 1 && 0 == ( ( mNow >> ( SLOT_BITS * level ) ) & SLOT_MASK ) )
+        {
+
+            level++;
+
+        }
+        for( ; level > 0; level-- )
+        {
+
+            Cascade( level );
+
+        }
+        // Fire everything in the current slot of level 0
+        while( NULL != mSlots[mNow & SLOT_MASK] )
+        {
+
+            timerPtr = mSlots[mNow & SLOT_MASK];
+            Cancel( *timerPtr );
+            if( NULL != timerPtr->mCallback )
+            {
+
+                timerPtr->mCallback( timerPtr->mContextPtr );
+
+            }
+
+        }
+
+    }
+
+private:
+
+    int mNow;                                           //!< Current frame
+    Timer * mSlots[NUM_LEVELS * NUM_SLOTS];             //!< Heads of the Timer lists, NUM_SLOTS per level
+
+    //! Links a Timer into the slot for its expiry frame
+    /*!
+        Insert() picks the lowest level which covers the Timer's remaining delay and links the
+        Timer into the slot of that level which contains its expiry frame.
+
+        \param rTimer : (Timer &) Timer to insert, with mExpiry already set
+    */
+    void Insert( Timer & rTimer )
+    {
+
+        int delay;              // Remaining delay
+        int level;              // Level to insert into
+        Timer ** headPtr;       // Pointer to the head of the slot
+
+        delay = rTimer.mExpiry - mNow;
+        level = 0;
+        while( level < NUM_LEVELS - 1 && delay >= ( 1 << ( SLOT_BITS * ( level + 1 ) ) ) )
+        {
+
+            level++;
+
+        }
+        rTimer.mLevel = level;
+        rTimer.mSlot = ( rTimer.mExpiry >> ( SLOT_BITS * level ) ) & SLOT_MASK;
+        headPtr = &mSlots[level * NUM_SLOTS + rTimer.mSlot];
+        rTimer.mPrevPtr = NULL;
+        rTimer.mNextPtr = *headPtr;
+        if( NULL != rTimer.mNextPtr )
+        {
+
+            rTimer.mNextPtr->mPrevPtr = &rTimer;
+
+        }
+        *headPtr = &rTimer;
+
+    }
+
+    //! Moves the Timers of the current slot of a level down
+    /*!
+        Cascade() takes all Timers out of the current slot of the given level and inserts them
+        again, which puts them into lower levels now that their expiry is closer.
+
+        \param rLevel : (int) Level to cascade (at least 1)
+    */
+    void Cascade( int rLevel )
+    {
+
+        Timer * timerPtr;       // Timer being moved
+        Timer ** headPtr;       // Pointer to the head of the slot
+
+        headPtr = &mSlots[rLevel * NUM_SLOTS + ( ( mNow >> ( SLOT_BITS * rLevel ) ) & SLOT_MASK )];
+        while( NULL != *headPtr )
+        {
+
+            timerPtr = *headPtr;
+            Cancel( *timerPtr );
+            Insert( *timerPtr );
+
+        }
+
+    }
+
+};
+
+//! Blit kernels for 8-bit Images
+/*!
+    This class provides the ways of copying pixels between Images which DynGauge can choose from.
+    All of them treat color 0 as transparent except CopyRows(), and all of them expect the
+    rectangles to lie inside both Images. The pixel rows of an Image are stored contiguously, one
+    byte per pixel.
+*/
+class Blitter
+{
+
+public:
+
+    //! Draws a rectangle, testing every pixel
+    /*!
+        BlitKeyed() copies the non-transparent pixels of a rectangle of one Image onto another,
+        one pixel at a time.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rSrcPtr : (RPG::Image *) Pointer to the source Image
+        \param rSrcX : (int) X coordinate in the source Image
+        \param rSrcY : (int) Y coordinate in the source Image
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+    */
+    static void BlitKeyed( RPG::Image * rDestPtr, int rX, int rY, RPG::Image * rSrcPtr, int rSrcX, int rSrcY, int rWidth, int rHeight )
+    {
+
+        int row, col;                   // Index variables
+        unsigned char * destRowPtr;     // Pointer to the current row in the destination Image
+        const unsigned char * srcRowPtr;// Pointer to the current row in the source Image
+
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            destRowPtr = rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX;
+            srcRowPtr = rSrcPtr->pixels + ( rSrcY + row ) * rSrcPtr->width + rSrcX;
+            for( col = 0; col < rWidth; col++ )
+            {
+
+                if( 0 != srcRowPtr[col] )
+                {
+
+                    destRowPtr[col] = srcRowPtr[col];
+
+                }
+
+            }
+
+        }
+
+    }
+
+    //! Copies a rectangle row by row
+    /*!
+        CopyRows() copies a rectangle of one Image onto another including its transparent pixels,
+        one memcpy() per row. It gives the same result as the keyed kernels only if the
+        destination rectangle is clear or the source has no transparent pixels.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rSrcPtr : (RPG::Image *) Pointer to the source Image
+        \param rSrcX : (int) X coordinate in the source Image
+        \param rSrcY : (int) Y coordinate in the source Image
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+    */
+    static void CopyRows( RPG::Image * rDestPtr, int rX, int rY, RPG::Image * rSrcPtr, int rSrcX, int rSrcY, int rWidth, int rHeight )
+    {
+
+        int row;                        // Index variable
+
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            memcpy( rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX,
+                    rSrcPtr->pixels + ( rSrcY + row ) * rSrcPtr->width + rSrcX,
+                    rWidth );
+
+        }
+
+    }
+
+#ifdef __SSE2__
+    //! Draws a rectangle, 16 pixels at a time
+    /*!
+        BlitSSE2() copies the non-transparent pixels of a rectangle of one Image onto another,
+        selecting between source and destination bytes with SSE2 masks, 16 pixels per step. The
+        rest of a row which does not fill a step is done one pixel at a time.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rSrcPtr : (RPG::Image *) Pointer to the source Image
+        \param rSrcX : (int) X coordinate in the source Image
+        \param rSrcY : (int) Y coordinate in the source Image
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+    */
+    static void BlitSSE2( RPG::Image * rDestPtr, int rX, int rY, RPG::Image * rSrcPtr, int rSrcX, int rSrcY, int rWidth, int rHeight )
     {
 
-        // Initialize variables
-        mBattlerPtr = rBattlerPtr;
-        mCurHealth = mBattlerPtr->hp;
-        mCurMana = mBattlerPtr->mp;
-        mCurATB = mBattlerPtr->atbValue;
-        mDisplayPtr = RPG::Image::create( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+        int row, col;                   // Index variables
+        unsigned char * destRowPtr;     // Pointer to the current row in the destination Image
+        const unsigned char * srcRowPtr;// Pointer to the current row in the source Image
+        __m128i zero;                   // All transparent pixels
+        __m128i src, dest, transparent; // Source pixels, destination pixels, transparency mask
+
+        zero = _mm_setzero_si128();
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            destRowPtr = rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX;
+            srcRowPtr = rSrcPtr->pixels + ( rSrcY + row ) * rSrcPtr->width + rSrcX;
+            for( col = 0; col + 16 <= rWidth; col += 16 )
+            {
+
+                src = _mm_loadu_si128( reinterpret_cast<const __m128i *>( srcRowPtr + col ) );
+                dest = _mm_loadu_si128( reinterpret_cast<const __m128i *>( destRowPtr + col ) );
+                transparent = _mm_cmpeq_epi8( src, zero );
+                dest = _mm_or_si128( _mm_and_si128( transparent, dest ), _mm_andnot_si128( transparent, src ) );
+                _mm_storeu_si128( reinterpret_cast<__m128i *>( destRowPtr + col ), dest );
+
+            }
+            for( ; col < rWidth; col++ )
+            {
+
+                if( 0 != srcRowPtr[col] )
+                {
+
+                    destRowPtr[col] = srcRowPtr[col];
+
+                }
+
+            }
+
+        }
+
+    }
+#endif
+
+    //! Composes a rectangle from the nine slices of another
+    /*!
+        NineSlice() fills a rectangle of one Image with a nine-slice composition of a rectangle
+        of another: the corners of the given border size are copied as they are, the edges and
+        the center are tiled to fill the rest. Transparent pixels are copied too, so the
+        destination rectangle is replaced. A destination as large as the source is an exact copy.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rWidth : (int) Width of the destination rectangle
+        \param rHeight : (int) Height of the destination rectangle
+        \param rSrcPtr : (RPG::Image *) Pointer to the source Image
+        \param rSrcX : (int) X coordinate in the source Image
+        \param rSrcY : (int) Y coordinate in the source Image
+        \param rSrcWidth : (int) Width of the source rectangle
+        \param rSrcHeight : (int) Height of the source rectangle
+        \param rBorder : (int) Width of the corners and edges, less than half the source size
+    */
+    static void NineSlice( RPG::Image * rDestPtr, int rX, int rY, int rWidth, int rHeight,
+                           RPG::Image * rSrcPtr, int rSrcX, int rSrcY, int rSrcWidth, int rSrcHeight, int rBorder )
+    {
+
+        int row, col;                   // Index variables
+        unsigned char * destRowPtr;     // Pointer to the current row in the destination Image
+        const unsigned char * srcRowPtr;// Pointer to the source row of the current row
+
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            destRowPtr = rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX;
+            srcRowPtr = rSrcPtr->pixels + ( rSrcY + SliceIndex( row, rHeight, rSrcHeight, rBorder ) ) * rSrcPtr->width + rSrcX;
+            for( col = 0; col < rWidth; col++ )
+            {
+
+                destRowPtr[col] = srcRowPtr[SliceIndex( col, rWidth, rSrcWidth, rBorder )];
+
+            }
+
+        }
+
+    }
+
+    //! Remaps the colors of a rectangle
+    /*!
+        Remap() replaces every pixel of a rectangle of an Image by its entry in a 256-byte remap
+        table, which turns drawn pixels into a color variant of themselves. Tables map 0 to 0, so
+        transparent pixels stay transparent.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the Image
+        \param rX : (int) X coordinate of the rectangle
+        \param rY : (int) Y coordinate of the rectangle
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+        \param rTablePtr : (const unsigned char *) Remap table
+    */
+    static void Remap( RPG::Image * rDestPtr, int rX, int rY, int rWidth, int rHeight, const unsigned char * rTablePtr )
+    {
+
+        int row, col;           // Index variables
+        unsigned char * rowPtr; // Pointer to the first pixel of the current row
+
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            rowPtr = rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX;
+            for( col = 0; col < rWidth; col++ )
+            {
+
+                rowPtr[col] = rTablePtr[rowPtr[col]];
+
+            }
+
+        }
+
+    }
+
+private:
+
+    //! Maps a row or column of a nine-slice composition to the source
+    /*!
+        \param rIndex : (int) Row or column in the destination rectangle
+        \param rSize : (int) Height or width of the destination rectangle
+        \param rSrcSize : (int) Height or width of the source rectangle
+        \param rBorder : (int) Width of the corners and edges
+        \return (int) Row or column in the source rectangle
+    */
+    static int SliceIndex( int rIndex, int rSize, int rSrcSize, int rBorder )
+    {
+
+        if( rIndex < rBorder )
+        {
+
+            return rIndex;
+
+        }
+        if( rIndex >= rSize - rBorder )
+        {
+
+            return rSrcSize - ( rSize - rIndex );
+
+        }
+        return rBorder + ( rIndex - rBorder ) % ( rSrcSize - 2 * rBorder );
+
+    }
+
+};
+
+//! Run-length encoded sprite
+/*!
+    This class holds a rectangle of an Image as runs of transparent and opaque pixels, so drawing
+    it skips transparent pixels in bulk and copies opaque ones with memcpy(). Each row is stored
+    as a run count followed by that many runs of [skip][count][count pixels]; runs longer than
+    255 pixels are split, and a row can have up to 255 runs. The run data of all sprites lives in
+    fixed static pools, so encoding never allocates.
+*/
+class RLESprite
+{
+
+public:
+
+    const static int DATA_POOL_SIZE = 32768;            //!< Bytes of run data for all sprites (the atlas needs at most about 30 KB)
+    const static int ROW_POOL_SIZE = 2048;              //!< Row offsets for all sprites (the atlas has about 1600 rows)
+
+    //! Default constructor
+    /*!
+        The default constructor of RLESprite provides an empty sprite.
+    */
+    RLESprite()
+    {
+
+        mWidth = 0;
+        mHeight = 0;
+        mDataPtr = NULL;
+        mRowPtr = NULL;
+        mSize = 0;
+
+    }
+
+    //! Empties the sprite
+    /*!
+        Clear() leaves an empty sprite. The pools are only ever appended to, so the space of the
+        run data is not reused; sprites are encoded once, when the atlas is set up.
+    */
+    void Clear()
+    {
+
+        mDataPtr = NULL;
+        mRowPtr = NULL;
+        mWidth = 0;
+        mHeight = 0;
+        mSize = 0;
+
+    }
+
+    //! Encodes a rectangle of an Image
+    /*!
+        Build() encodes a rectangle of an Image, with color 0 as the transparent color. The rows
+        are encoded twice: once to measure the data, then into an exactly sized part of the pool.
+        If the pools are full, the sprite stays empty.
+
+        \param rSrcPtr : (RPG::Image *) Pointer to the source Image
+        \param rSrcX : (int) X coordinate of the rectangle in the source Image
+        \param rSrcY : (int) Y coordinate of the rectangle in the source Image
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+        \return (bool) true if the rectangle was encoded
+    */
+    bool Build( RPG::Image * rSrcPtr, int rSrcX, int rSrcY, int rWidth, int rHeight )
+    {
+
+        int row;                // Index variable
+        int size;               // Number of bytes of run data
+
+        Clear();
+        // Measure
+        size = 0;
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            size += EncodeRow( rSrcPtr->pixels + ( rSrcY + row ) * rSrcPtr->width + rSrcX, rWidth, NULL );
+
+        }
+        if( mDataUsed + size > DATA_POOL_SIZE || mRowsUsed + rHeight > ROW_POOL_SIZE )
+        {
+
+            return false;
+
+        }
+        // Encode
+        mWidth = rWidth;
+        mHeight = rHeight;
+        mDataPtr = mDataPool + mDataUsed;
+        mRowPtr = mRowPool + mRowsUsed;
+        mDataUsed += size;
+        mRowsUsed += rHeight;
+        for( row = 0; row < rHeight; row++ )
+        {
+
+            mRowPtr[row] = mSize;
+            mSize += EncodeRow( rSrcPtr->pixels + ( rSrcY + row ) * rSrcPtr->width + rSrcX, rWidth, mDataPtr + mSize );
+
+        }
+        return true;
+
+    }
+
+    //! Draws the sprite
+    /*!
+        Draw() draws the whole sprite onto an Image.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+    */
+    void Draw( RPG::Image * rDestPtr, int rX, int rY )
+    {
+
+        DrawColumns( rDestPtr, rX, rY, 0, mWidth );
+
+    }
+
+    //! Draws some columns of the sprite
+    /*!
+        DrawColumns() draws the columns from rLeft up to (not including) rRight of the sprite
+        onto an Image, with column rLeft at the given coordinates, just like drawing the rectangle
+        from (rLeft, 0) of the source Image with RPG::Image::draw().
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rLeft : (int) First column to draw
+        \param rRight : (int) Column after the last one to draw
+    */
+    void DrawColumns( RPG::Image * rDestPtr, int rX, int rY, int rLeft, int rRight )
+    {
+
+        int row, run;                   // Index variables
+        int runs;                       // Number of runs in the current row
+        int col;                        // Current column of the sprite
+        int start, end;                 // Columns of the current opaque run, after clipping
+        const unsigned char * srcPtr;   // Pointer to the current position in the run data
+        unsigned char * destRowPtr;     // Pointer to column 0 of the sprite in the current destination row
+
+        for( row = 0; row < mHeight; row++ )
+        {
+
+            srcPtr = mDataPtr + mRowPtr[row];
+            destRowPtr = rDestPtr->pixels + ( rY + row ) * rDestPtr->width + rX - rLeft;
+            runs = *srcPtr++;
+            col = 0;
+            for( run = 0; run < runs && col < rRight; run++ )
+            {
+
+                col += srcPtr[0];
+                start = ( col < rLeft ) ? rLeft : col;
+                end = ( col + srcPtr[1] > rRight ) ? rRight : col + srcPtr[1];
+                if( end > start )
+                {
+
+                    memcpy( destRowPtr + start, srcPtr + 2 + ( start - col ), end - start );
+
+                }
+                col += srcPtr[1];
+                srcPtr += 2 + srcPtr[1];
+
+            }
+
+        }
+
+    }
+
+    //! Gets the size of the run data
+    /*!
+        \return (int) Number of bytes of run data (0 = empty sprite)
+    */
+    int Size()
+    {
+
+        return mSize;
+
+    }
+
+    //! Gets the size of the pools
+    /*!
+        \return (int) Number of bytes of the pools used by all sprites
+    */
+    static int PoolBytes()
+    {
+
+        return mDataUsed + mRowsUsed * static_cast<int>( sizeof( int ) );
+
+    }
+
+private:
+
+    static unsigned char mDataPool[DATA_POOL_SIZE];     //!< Run data of all sprites
+    static int mRowPool[ROW_POOL_SIZE];                 //!< Row offsets of all sprites
+    static int mDataUsed;                               //!< Number of bytes used in mDataPool
+    static int mRowsUsed;                               //!< Number of entries used in mRowPool
+
+    int mWidth;                                         //!< Width of the sprite
+    int mHeight;                                        //!< Height of the sprite
+    unsigned char * mDataPtr;                           //!< Pointer to the run data
+    int * mRowPtr;                                      //!< Pointer to the offsets of the rows in the run data
+    int mSize;                                          //!< Number of bytes of run data
+
+    //! Encodes a row
+    /*!
+        EncodeRow() encodes one row of pixels, or only measures it if no output is given.
+
+        \param rSrcPtr : (const unsigned char *) Pointer to the first pixel of the row
+        \param rWidth : (int) Number of pixels in the row
+        \param rOutPtr : (unsigned char *) Pointer to the output (NULL = only measure)
+        \return (int) Number of bytes of the encoded row
+    */
+    static int EncodeRow( const unsigned char * rSrcPtr, int rWidth, unsigned char * rOutPtr )
+    {
+
+        int col;                // Current column
+        int skip, count;        // Lengths of the current transparent and opaque runs
+        int size;               // Number of bytes written
+        int runs;               // Number of runs written
+
+        size = 1;
+        runs = 0;
+        col = 0;
+        while( col < rWidth )
+        {
+
+            skip = 0;
+            while( col < rWidth && 0 == rSrcPtr[col] && skip < 255 )
+            {
+
+                skip++;
+                col++;
+
+            }
+            count = 0;
+            while( col < rWidth && 0 != rSrcPtr[col] && count < 255 )
+            {
+
+                count++;
+                col++;
+
+            }
+            if( 0 == count && col >= rWidth )
+            {   // Trailing transparent pixels need no run
+
+                break;
+
+            }
+            if( NULL != rOutPtr )
+            {
+
+                rOutPtr[size] = static_cast<unsigned char>( skip );
+                rOutPtr[size + 1] = static_cast<unsigned char>( count );
+                memcpy( rOutPtr + size + 2, rSrcPtr + col - count, count );
+
+            }
+            size += 2 + count;
+            runs++;
+
+        }
+        if( NULL != rOutPtr )
+        {
+
+            rOutPtr[0] = static_cast<unsigned char>( runs );
+
+        }
+        return size;
+
+    }
+
+};
+
+unsigned char RLESprite::mDataPool[RLESprite::DATA_POOL_SIZE];
+int RLESprite::mRowPool[RLESprite::ROW_POOL_SIZE];
+int RLESprite::mDataUsed = 0;
+int RLESprite::mRowsUsed = 0;
+
+//! Sprite of the atlas
+/*!
+    This class is a rectangle of an Image which DynGauge draws from, together with its run-length
+    encoded version. Every Sprite belongs to a class (gauge frames, bars, digits, ...) and is
+    drawn with the blit kernel currently selected for its class, so the kernel can be tuned per
+    class without the callers knowing.
+*/
+class Sprite
+{
+
+public:
+
+    const static int KERNEL_ENGINE = 0;                 //!< Kernel: RPG::Image::draw()
+    const static int KERNEL_KEYED = 1;                  //!< Kernel: Blitter::BlitKeyed()
+    const static int KERNEL_RLE = 2;                    //!< Kernel: RLESprite::DrawColumns()
+    const static int KERNEL_SSE2 = 3;                   //!< Kernel: Blitter::BlitSSE2() (only in builds targeting SSE2)
+    const static int NUM_KERNELS = 4;                   //!< Amount of kernels
+    const static int CLASS_GAUGE = 0;                   //!< Class: gauge frames
+    const static int CLASS_BAR = 1;                     //!< Class: bars
+    const static int CLASS_DIGIT = 2;                   //!< Class: digits
+    const static int CLASS_ICON = 3;                    //!< Class: status condition icons
+    const static int CLASS_COUNTER = 4;                 //!< Class: turn counter strips
+    const static int NUM_CLASSES = 5;                   //!< Amount of classes
+
+    static int mKernel[NUM_CLASSES];                    //!< Kernel selected for each class
+
+    //! Default constructor
+    /*!
+        The default constructor of Sprite provides an empty sprite.
+    */
+    Sprite()
+    {
+
+        mImagePtr = NULL;
+        mX = 0;
+        mY = 0;
+        mWidth = 0;
+        mHeight = 0;
+        mClass = CLASS_GAUGE;
+
+    }
+
+    //! Sets up the Sprite
+    /*!
+        Build() sets the rectangle of the Sprite and encodes it. The Image must stay alive and
+        unchanged for as long as the Sprite is used.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the source Image
+        \param rX : (int) X coordinate of the rectangle in the source Image
+        \param rY : (int) Y coordinate of the rectangle in the source Image
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+        \param rClass : (int) Class of the Sprite
+    */
+    void Build( RPG::Image * rImagePtr, int rX, int rY, int rWidth, int rHeight, int rClass )
+    {
+
+        mImagePtr = rImagePtr;
+        mX = rX;
+        mY = rY;
+        mWidth = rWidth;
+        mHeight = rHeight;
+        mClass = rClass;
+        mRLE.Build( rImagePtr, rX, rY, rWidth, rHeight );
+
+    }
+
+    //! Checks whether the Sprite has been set up
+    /*!
+        \return (bool) true if Build() has been called
+    */
+    bool IsBuilt()
+    {
+
+        return NULL != mImagePtr;
+
+    }
+
+    //! Points the Sprite to a new copy of its Image
+    /*!
+        Rebind() is used when an evicted Image was created again with the same pixels, so the
+        encoded version is still valid and is kept.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the new source Image
+    */
+    void Rebind( RPG::Image * rImagePtr )
+    {
+
+        mImagePtr = rImagePtr;
+
+    }
+
+    //! Draws the Sprite
+    /*!
+        Draw() draws the whole Sprite onto an Image with the kernel of its class.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+    */
+    void Draw( RPG::Image * rDestPtr, int rX, int rY )
+    {
+
+        DrawWith( mKernel[mClass], rDestPtr, rX, rY, 0, mWidth );
+
+    }
+
+    //! Draws some columns of the Sprite
+    /*!
+        DrawColumns() draws the columns from rLeft up to (not including) rRight of the Sprite
+        onto an Image with the kernel of its class, with column rLeft at the given coordinates.
+
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rLeft : (int) First column to draw
+        \param rRight : (int) Column after the last one to draw
+    */
+    void DrawColumns( RPG::Image * rDestPtr, int rX, int rY, int rLeft, int rRight )
+    {
+
+        DrawWith( mKernel[mClass], rDestPtr, rX, rY, rLeft, rRight );
+
+    }
+
+    //! Draws some columns of the Sprite with a given kernel
+    /*!
+        DrawWith() is DrawColumns() with an explicitly chosen kernel, as needed to compare the
+        kernels. All kernels give the same result.
+
+        \param rKernel : (int) Kernel to use
+        \param rDestPtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate in the destination Image
+        \param rY : (int) Y coordinate in the destination Image
+        \param rLeft : (int) First column to draw
+        \param rRight : (int) Column after the last one to draw
+    */
+    void DrawWith( int rKernel, RPG::Image * rDestPtr, int rX, int rY, int rLeft, int rRight )
+    {
+
+        switch( rKernel )
+        {
+
+        case KERNEL_ENGINE:
+            rDestPtr->draw( rX, rY, mImagePtr, mX + rLeft, mY, rRight - rLeft, mHeight, 0 );
+            break;
+        case KERNEL_KEYED:
+            Blitter::BlitKeyed( rDestPtr, rX, rY, mImagePtr, mX + rLeft, mY, rRight - rLeft, mHeight );
+            break;
+#ifdef __SSE2__
+        case KERNEL_SSE2:
+            Blitter::BlitSSE2( rDestPtr, rX, rY, mImagePtr, mX + rLeft, mY, rRight - rLeft, mHeight );
+            break;
+#endif
+        default:
+            if( 0 < mRLE.Size() )
+            {
+
+                mRLE.DrawColumns( rDestPtr, rX, rY, rLeft, rRight );
+
+            }
+            else
+            {   // Did not fit into the pools
+
+                Blitter::BlitKeyed( rDestPtr, rX, rY, mImagePtr, mX + rLeft, mY, rRight - rLeft, mHeight );
+
+            }
+            break;
+
+        }
+
+    }
+
+    //! Checks whether a kernel is available
+    /*!
+        \param rKernel : (int) Kernel to check
+        \return (bool) true if the kernel is part of this build
+    */
+    static bool KernelAvailable( int rKernel )
+    {
+
+#ifdef __SSE2__
+        return 0 <= rKernel && rKernel < NUM_KERNELS;
+#else
+        return 0 <= rKernel && rKernel < NUM_KERNELS && KERNEL_SSE2 != rKernel;
+#endif
+
+    }
+
+    RPG::Image * mImagePtr;                             //!< Pointer to the source Image
+    int mX;                                             //!< X coordinate of the rectangle in the source Image
+    int mY;                                             //!< Y coordinate of the rectangle in the source Image
+    int mWidth;                                         //!< Width of the rectangle
+    int mHeight;                                        //!< Height of the rectangle
+    int mClass;                                         //!< Class of the Sprite
+    RLESprite mRLE;                                     //!< Run-length encoded version of the rectangle
+
+};
+
+int Sprite::mKernel[Sprite::NUM_CLASSES] = { Sprite::KERNEL_RLE, Sprite::KERNEL_RLE, Sprite::KERNEL_RLE, Sprite::KERNEL_RLE, Sprite::KERNEL_RLE };
+
+//! Arena of per-battle Images
+/*!
+    This class owns the Images used during a battle. Images are handed out by Acquire() and are
+    all given back at once by Reset() when the battle ends, which only advances a generation
+    counter; the Images themselves stay alive and are handed out again, cleared, to later requests
+    of the same size. After the first battles the engine is thus not asked for pixel memory
+    anymore, so long play sessions do not fragment its heap. All Images are destroyed by
+    Destroy() when the game closes.
+*/
+class ImageArena
+{
+
+public:
+
+    const static int MAX_IMAGES = 64;                   //!< Maximum number of Images in the arena
+
+    //! Default constructor
+    /*!
+        The default constructor of ImageArena provides an empty arena.
+    */
+    ImageArena()
+    {
+
+        mCount = 0;
+        mGeneration = 1;
+
+    }
+
+    //! Hands out an Image
+    /*!
+        Acquire() returns a cleared Image of the given size which is not in use in the current
+        battle, creating one only if no free Image of that size exists.
+
+        \param rWidth : (int) Width of the Image
+        \param rHeight : (int) Height of the Image
+        \return (RPG::Image *) Pointer to the Image, or NULL if the arena is full
+    */
+    RPG::Image * Acquire( int rWidth, int rHeight )
+    {
+
+        int i;                  // Index variable
+
+        for( i = 0; i < mCount; i++ )
+        {
+
+            if( mGeneration != mUsedIn[i] && rWidth == mImagePtr[i]->width && rHeight == mImagePtr[i]->height )
+            {
+
+                mUsedIn[i] = mGeneration;
+                mImagePtr[i]->clear();
+                return mImagePtr[i];
+
+            }
+
+        }
+        if( MAX_IMAGES == mCount )
+        {
+
+            return NULL;
+
+        }
+        mImagePtr[mCount] = RPG::Image::create( rWidth, rHeight );
+        mUsedIn[mCount] = mGeneration;
+        return mImagePtr[mCount++];
+
+    }
+
+    //! Gives back one Image
+    /*!
+        Release() makes an Image handed out in this battle free again, so it can be handed out
+        again or trimmed. The pointer must not be used anymore.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the Image (NULL = none)
+    */
+    void Release( RPG::Image * rImagePtr )
+    {
+
+        int i;                  // Index variable
+
+        for( i = 0; i < mCount; i++ )
+        {
+
+            if( rImagePtr == mImagePtr[i] )
+            {
+
+                mUsedIn[i] = mGeneration - 1;
+                return;
+
+            }
+
+        }
+
+    }
+
+    //! Gives back all Images
+    /*!
+        Reset() makes every Image of the arena free again. Pointers handed out before must not be
+        used anymore.
+    */
+    void Reset()
+    {
+
+        mGeneration++;
+
+    }
+
+    //! Gets the current generation
+    /*!
+        \return (int) Generation of the current battle; Reset() moves on to the next one
+    */
+    int Generation()
+    {
+
+        return mGeneration;
+
+    }
+
+    //! Gets the size of the arena
+    /*!
+        \param rFreeOnly : (bool) Whether to count only the Images not in use in this battle
+        \return (int) Number of pixel bytes of the Images
+    */
+    int Bytes( bool rFreeOnly )
+    {
+
+        int i;                  // Index variable
+        int bytes;              // Sum of the sizes
+
+        bytes = 0;
+        for( i = 0; i < mCount; i++ )
+        {
+
+            if( !rFreeOnly || mGeneration != mUsedIn[i] )
+            {
+
+                bytes += mImagePtr[i]->width * mImagePtr[i]->height;
+
+            }
+
+        }
+        return bytes;
+
+    }
+
+    //! Destroys free Images
+    /*!
+        Trim() destroys Images which are not in use in this battle until at least the given
+        number of bytes was freed or no free Image is left.
+
+        \param rBytes : (int) Number of bytes to free
+        \return (int) Number of bytes freed
+    */
+    int Trim( int rBytes )
+    {
+
+        int i;                  // Index variable
+        int freed;              // Number of bytes freed so far
+
+        freed = 0;
+        for( i = mCount - 1; 0 <= i && freed < rBytes; i-- )
+        {
+
+            if( mGeneration != mUsedIn[i] )
+            {
+
+                freed += mImagePtr[i]->width * mImagePtr[i]->height;
+                RPG::Image::destroy( mImagePtr[i] );
+                // Keep the Images packed
+                mCount--;
+                mImagePtr[i] = mImagePtr[mCount];
+                mUsedIn[i] = mUsedIn[mCount];
+
+            }
+
+        }
+        return freed;
+
+    }
+
+    //! Destroys all Images
+    /*!
+        Destroy() destroys every Image of the arena, leaving it empty.
+    */
+    void Destroy()
+    {
+
+        int i;                  // Index variable
+
+        for( i = 0; i < mCount; i++ )
+        {
+
+            RPG::Image::destroy( mImagePtr[i] );
+
+        }
+        mCount = 0;
+        mGeneration++;
+
+    }
+
+private:
+
+    RPG::Image * mImagePtr[MAX_IMAGES];                 //!< Images of the arena
+    int mUsedIn[MAX_IMAGES];                            //!< Generation in which each Image was last handed out
+    int mCount;                                         //!< Number of Images in the arena
+    int mGeneration;                                    //!< Current generation; Images of older generations are free
+
+};
+
+//! Opaque bounds of monster graphics
+/*!
+    This class finds the rectangle of a monster graphic which holds its opaque pixels, so displays
+    can be placed above what is actually drawn instead of above the whole, mostly transparent,
+    graphic. Each graphic is loaded and scanned once, when a monster using it first appears; the
+    results are kept in a fixed table keyed by file name. The hue of a monster only changes its
+    colors, so it does not change the bounds and is not part of the key.
+
+    The table is kept in a small binary cache file between sessions. Each entry remembers the
+    size and modification time of the graphic it was measured from; an entry read from the
+    cache is trusted once these still match, so a graphic is only scanned again after it changed.
+*/
+class SpriteMetrics
+{
+
+public:
+
+    const static int MAX_ENTRIES = 64;                  //!< Maximum number of graphics whose bounds are kept
+    const static int MAX_NAME_LENGTH = 64;              //!< Size of the file name buffer of an entry
+    const static int MAX_PATH_LENGTH = 260;             //!< Size of the file name buffer of the cache file
+    const static int CACHE_MAGIC = 0x4D534744;          //!< First word of the cache file ("DGSM")
+    const static int CACHE_VERSION = 1;                 //!< Version of the cache file layout
+
+    //! Bounds of a graphic
+    struct Bounds
+    {
+
+        int mWidth;                                     //!< Width of the graphic
+        int mHeight;                                    //!< Height of the graphic
+        int mLeft;                                      //!< First column with an opaque pixel
+        int mTop;                                       //!< First row with an opaque pixel
+        int mRight;                                     //!< Column after the last one with an opaque pixel
+        int mBottom;                                    //!< Row after the last one with an opaque pixel
+
+    };
+
+    //! Gets the bounds of a monster graphic
+    /*!
+        Find() returns the bounds of the graphic from the table, or loads the graphic and
+        measures it if it is not in the table yet. The graphic is looked for as a PNG or BMP
+        file in the game's Monster folder, then in the Monster folder of the RTP. A graphic which
+        cannot be found or loaded, or which is fully transparent, has no bounds; this is
+        remembered for the session too, so it is not tried again.
+
+        \param rFileNamePtr : (const char *) File name of the graphic, without folder
+        \param rBounds : (Bounds &) Receives the bounds
+        \return (bool) true if the graphic has bounds
+    */
+    static bool Find( const char * rFileNamePtr, Bounds & rBounds )
+    {
+
+        int i;                  // Index variable
+        Entry * entryPtr;       // Entry of the graphic
+        FileStamp stamp;        // Size and modification time of the graphic
+        std::string path;       // File the graphic is loaded from
+        bool found;             // Whether the file of the graphic was found
+        RPG::Image * imagePtr;  // Graphic being measured
+
+        entryPtr = NULL;
+        for( i = 0; i < mCount; i++ )
+        {
+
+            if( 0 == strcmp( rFileNamePtr, mEntry[i].mName ) )
+            {
+
+                entryPtr = &mEntry[i];
+                break;
+
+            }
+
+        }
+        if( NULL != entryPtr && entryPtr->mChecked )
+        {
+
+            rBounds = entryPtr->mBounds;
+            return entryPtr->mValid;
+
+        }
+        found = Locate( rFileNamePtr, path, stamp );
+        if( NULL != entryPtr && entryPtr->mStamp.mSize == stamp.mSize && entryPtr->mStamp.mTimeLow == stamp.mTimeLow && entryPtr->mStamp.mTimeHigh == stamp.mTimeHigh )
+        {   // Entry from the cache file, and the graphic did not change since
+
+            entryPtr->mChecked = true;
+            rBounds = entryPtr->mBounds;
+            return entryPtr->mValid;
+
+        }
+        if( NULL == entryPtr )
+        {   // Not measured yet; names too long for an entry are measured every time
+
+            entryPtr = ( MAX_ENTRIES > mCount && MAX_NAME_LENGTH > static_cast<int>( strlen( rFileNamePtr ) ) ) ? &mEntry[mCount++] : &mScratch;
+
+        }
+        memset( entryPtr, 0, sizeof( Entry ) );
+        strncpy( entryPtr->mName, rFileNamePtr, MAX_NAME_LENGTH - 1 );
+        if( found )
+        {
+
+            imagePtr = RPG::Image::create();
+            imagePtr->loadFromFile( path, false );
+            entryPtr->mValid = Measure( imagePtr, entryPtr->mBounds );
+            RPG::Image::destroy( imagePtr );
+
+        }
+        entryPtr->mStamp = stamp;
+        entryPtr->mChecked = true;
+        mDirty = mDirty || &mScratch != entryPtr;
+        rBounds = entryPtr->mBounds;
+        return entryPtr->mValid;
+
+    }
+
+    //! Measures the opaque bounds of an Image
+    /*!
+        Measure() scans the rows of an Image for their first and last opaque (non-zero) pixels.
+        Builds targeting SSE2 test 16 pixels per step and find the opaque ones of a step from its
+        bit mask; the rest of a row is tested one pixel at a time.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the Image
+        \param rBounds : (Bounds &) Receives the bounds
+        \return (bool) true if the Image has an opaque pixel
+    */
+    static bool Measure( RPG::Image * rImagePtr, Bounds & rBounds )
+    {
+
+        int row, col;           // Index variables
+        int left, right;        // First opaque column and column after the last one in the current row
+        const unsigned char * rowPtr;   // Pointer to the current row
+#ifdef __SSE2__
+        __m128i zero;           // All transparent pixels
+        int opaque;             // Bit mask of the opaque pixels of the current step
+
+        zero = _mm_setzero_si128();
+#endif
+        rBounds.mWidth = rImagePtr->width;
+        rBounds.mHeight = rImagePtr->height;
+        rBounds.mLeft = rImagePtr->width;
+        rBounds.mTop = rImagePtr->height;
+        rBounds.mRight = 0;
+        rBounds.mBottom = 0;
+        for( row = 0; row < rImagePtr->height; row++ )
+        {
+
+            rowPtr = rImagePtr->pixels + row * rImagePtr->width;
+            left = -1;
+            right = -1;
+            col = 0;
+#ifdef __SSE2__
+            for( ; col + 16 <= rImagePtr->width; col += 16 )
+            {
+
+                opaque = ~_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i *>( rowPtr + col ) ), zero ) ) & 0xFFFF;
+                if( 0 != opaque )
+                {
+
+                    if( 0 > left )
+                    {
+
+                        left = col + __builtin_ctz( opaque );
+
+                    }
+                    right = col + 32 - __builtin_clz( opaque );
+
+                }
+
+            }
+#endif
+            for( ; col < rImagePtr->width; col++ )
+            {
+
+                if( 0 != rowPtr[col] )
+                {
+
+                    if( 0 > left )
+                    {
+
+                        left = col;
+
+                    }
+                    right = col + 1;
+
+                }
+
+            }
+            if( 0 <= left )
+            {
+
+                rBounds.mLeft = ( left < rBounds.mLeft ) ? left : rBounds.mLeft;
+                rBounds.mRight = ( right > rBounds.mRight ) ? right : rBounds.mRight;
+                rBounds.mTop = ( row < rBounds.mTop ) ? row : rBounds.mTop;
+                rBounds.mBottom = row + 1;
+
+            }
+
+        }
+        return rBounds.mBottom > rBounds.mTop;
+
+    }
+
+    //! Loads the table from the cache file
+    /*!
+        Load() reads the whole cache file into the table in one go. A file which is missing,
+        from another version, or damaged is ignored and the table starts empty; it is replaced
+        by the next Save().
+
+        \param rFileNamePtr : (const char *) File name of the cache file; an empty name disables the cache
+    */
+    static void Load( const char * rFileNamePtr )
+    {
+
+        int header[4];          // Magic word, version, size of an entry and number of entries
+        int i;                  // Index variable
+
+        strncpy( mCacheFile, rFileNamePtr, MAX_PATH_LENGTH - 1 );
+        mCacheFile[MAX_PATH_LENGTH - 1] = '\0';
+        mCount = 0;
+        mDirty = false;
+        if( '\0' == mCacheFile[0] )
+        {
+
+            return;
+
+        }
+        std::ifstream cache( mCacheFile, std::ios::binary );     // Cache file
+        if( !cache.read( reinterpret_cast<char *>( header ), sizeof( header ) )
+            || CACHE_MAGIC != header[0] || CACHE_VERSION != header[1] || static_cast<int>( sizeof( Entry ) ) != header[2]
+            || 0 > header[3] || MAX_ENTRIES < header[3]
+            || !cache.read( reinterpret_cast<char *>( mEntry ), header[3] * sizeof( Entry ) ) )
+        {
+
+            return;
+
+        }
+        for( i = 0; i < header[3]; i++ )
+        {   // Names are checked, and every graphic's stamp once more in this session
+
+            mEntry[i].mName[MAX_NAME_LENGTH - 1] = '\0';
+            mEntry[i].mChecked = false;
+            if( Persistent( mEntry[i] ) )
+            {   // Files of older builds may hold graphics without bounds; they are measured again
+
+                mEntry[mCount++] = mEntry[i];
+
+            }
+
+        }
+
+    }
+
+    //! Writes the table to the cache file, if anything was measured since it was loaded
+    /*!
+        Save() only writes entries of graphics which were found and have bounds. A graphic which
+        could not be measured may be fixed or installed before the next session, so it is tried
+        again then instead of being remembered as having no bounds.
+    */
+    static void Save()
+    {
+
+        int header[4];          // Magic word, version, size of an entry and number of entries
+        int i;                  // Index variable
+
+        if( !mDirty || '\0' == mCacheFile[0] )
+        {
+
+            return;
+
+        }
+        header[0] = CACHE_MAGIC;
+        header[1] = CACHE_VERSION;
+        header[2] = sizeof( Entry );
+        header[3] = 0;
+        for( i = 0; i < mCount; i++ )
+        {
+
+            header[3] += Persistent( mEntry[i] ) ? 1 : 0;
+
+        }
+        std::ofstream cache( mCacheFile, std::ios::binary | std::ios::trunc );    // Cache file
+        cache.write( reinterpret_cast<const char *>( header ), sizeof( header ) );
+        for( i = 0; i < mCount; i++ )
+        {
+
+            if( Persistent( mEntry[i] ) )
+            {
+
+                cache.write( reinterpret_cast<const char *>( &mEntry[i] ), sizeof( Entry ) );
+
+            }
+
+        }
+        mDirty = !cache;
+
+    }
+
+    //! Sets the folder of the RTP
+    /*!
+        SetRtpPath() sets where graphics which are not part of the game are looked for. Without
+        a path, the RuntimePackagePath of an installed RPG Maker 2003 RTP is read from the
+        registry.
+
+        \param rPathPtr : (const char *) Folder of the RTP, or an empty string to find it
+    */
+    static void SetRtpPath( const char * rPathPtr )
+    {
+
+        const static HKEY ROOTS[] = { HKEY_CURRENT_USER, HKEY_LOCAL_MACHINE, HKEY_LOCAL_MACHINE };
+        const static char * KEYS[] = { "Software\\ASCII\\RPG2003", "Software\\ASCII\\RPG2003", "Software\\Enterbrain\\RPG2003" };
+        int i;                  // Index variable
+        HKEY key;               // Registry key of the RTP
+        DWORD type, size;       // Type and size of the registry value
+
+        strncpy( mRtpPath, rPathPtr, MAX_PATH_LENGTH - 1 );
+        mRtpPath[MAX_PATH_LENGTH - 1] = '\0';
+        for( i = 0; '\0' == mRtpPath[0] && i < static_cast<int>( sizeof( KEYS ) / sizeof( KEYS[0] ) ); i++ )
+        {
+
+            if( ERROR_SUCCESS == RegOpenKeyExA( ROOTS[i], KEYS[i], 0, KEY_READ, &key ) )
+            {
+
+                size = MAX_PATH_LENGTH - 1;
+                if( ERROR_SUCCESS != RegQueryValueExA( key, "RuntimePackagePath", NULL, &type, reinterpret_cast<BYTE *>( mRtpPath ), &size )
+                    || REG_SZ != type )
+                {
+
+                    mRtpPath[0] = '\0';
+
+                }
+                mRtpPath[MAX_PATH_LENGTH - 1] = '\0';
+                RegCloseKey( key );
+
+            }
+
+        }
+
+    }
+
+private:
+
+    //! Size and modification time of a graphic file
+    struct FileStamp
+    {
+
+        unsigned int mSize;                             //!< Size of the file in bytes
+        unsigned int mTimeLow;                          //!< Low word of the modification time
+        unsigned int mTimeHigh;                         //!< High word of the modification time
+
+    };
+
+    //! Entry of the table
+    struct Entry
+    {
+
+        char mName[MAX_NAME_LENGTH];                    //!< File name of the graphic
+        Bounds mBounds;                                 //!< Bounds of the graphic
+        FileStamp mStamp;                               //!< Size and modification time of the graphic when it was measured
+        bool mValid;                                    //!< Whether the graphic has bounds
+        bool mChecked;                                  //!< Whether the entry is known to match the graphic in this session
+
+    };
+
+    //! Checks whether an entry is kept in the cache file
+    /*!
+        \param rEntry : (const Entry &) Entry to check
+        \return (bool) true if the graphic was found and has bounds
+    */
+    static bool Persistent( const Entry & rEntry )
+    {
+
+        return rEntry.mValid && ( 0 != rEntry.mStamp.mSize || 0 != rEntry.mStamp.mTimeLow || 0 != rEntry.mStamp.mTimeHigh );
+
+    }
+
+    //! Finds the file of a monster graphic
+    /*!
+        Locate() looks for the graphic as a PNG or BMP file, the formats RPG::Image can load, in
+        the game's Monster folder, then in the Monster folder of the RTP. A graphic which is not
+        found gets an all-zero stamp.
+
+        \param rFileNamePtr : (const char *) File name of the graphic as in the database, without folder and extension
+        \param rPath : (std::string &) Receives the path of the file
+        \param rStamp : (FileStamp &) Receives the size and modification time of the file
+        \return (bool) true if the file was found
+    */
+    static bool Locate( const char * rFileNamePtr, std::string & rPath, FileStamp & rStamp )
+    {
+
+        const static char * EXTENSIONS[] = { ".png", ".bmp" };    // Extensions tried, in order
+        int folder, i;          // Index variables
+        WIN32_FILE_ATTRIBUTE_DATA attributes;   // Attributes of the file
+
+        memset( &rStamp, 0, sizeof( rStamp ) );
+        for( folder = 0; folder < 2; folder++ )
+        {
+
+            if( 1 == folder && '\0' == mRtpPath[0] )
+            {
+
+                break;
+
+            }
+            for( i = 0; i < static_cast<int>( sizeof( EXTENSIONS ) / sizeof( EXTENSIONS[0] ) ); i++ )
+            {
+
+                rPath = ( 0 == folder ) ? std::string() : std::string( mRtpPath ) + "\\";
+                rPath += std::string( "Monster\\" ) + rFileNamePtr + EXTENSIONS[i];
+                if( GetFileAttributesExA( rPath.c_str(), GetFileExInfoStandard, &attributes ) )
+                {
+
+                    rStamp.mSize = attributes.nFileSizeLow;
+                    rStamp.mTimeLow = attributes.ftLastWriteTime.dwLowDateTime;
+                    rStamp.mTimeHigh = attributes.ftLastWriteTime.dwHighDateTime;
+                    return true;
+
+                }
+
+            }
+
+        }
+        return false;
+
+    }
+
+    static Entry mEntry[MAX_ENTRIES];                   //!< Table of measured graphics
+    static int mCount;                                  //!< Number of entries in mEntry
+    static Entry mScratch;                              //!< Entry for graphics which do not fit into the table
+    static char mCacheFile[MAX_PATH_LENGTH];            //!< File name of the cache file; empty if there is none
+    static bool mDirty;                                 //!< Whether the table changed since the cache file was read or written
+    static char mRtpPath[MAX_PATH_LENGTH];              //!< Folder of the RTP; empty if there is none
+
+};
+
+SpriteMetrics::Entry SpriteMetrics::mEntry[SpriteMetrics::MAX_ENTRIES];
+int SpriteMetrics::mCount = 0;
+SpriteMetrics::Entry SpriteMetrics::mScratch;
+char SpriteMetrics::mCacheFile[SpriteMetrics::MAX_PATH_LENGTH];
+bool SpriteMetrics::mDirty = false;
+char SpriteMetrics::mRtpPath[SpriteMetrics::MAX_PATH_LENGTH];
+
+//! Battle display for a single Battler
+/*!
+    This class handles the modeling and displaying of battle information for a single Battler (hero
+    or monster) including gauges for health, mana, and ATB, plus
+*/
+class BattleDisplay
+{
+
+public:
+
+    const static int DISPLAY_WIDTH = 80;                //!< Width of the display Image (TODO: probably will change this, currently set to more than it needs to be for experimental purposes)
+    const static int DISPLAY_HEIGHT = 320;              //!< Height of the display Image (TODO: probably will change this, currently set to more than it needs to be for experimental purposes)
+    const static int IMAGE_UNIT_SIZE = 8;               //!< Unit size for Images (smallest possible width/height for an Image)
+    const static int GAUGE_WIDTH = 40;                  //!< Width of a gauge Image
+    const static int GAUGE_HEIGHT = 8;                  //!< Height of a gauge Image
+    const static int HEALTH_GAUGE_SRC_X = 0;            //!< Source X coordinate of health gauge in SystemGraphic
+    const static int HEALTH_GAUGE_SRC_Y = 40;           //!< Source Y coordinate of health gauge in SystemGraphic
+    const static int MANA_GAUGE_SRC_X = 0;              //!< Source X coordinate of mana gauge in SystemGraphic
+    const static int MANA_GAUGE_SRC_Y = 56;             //!< Source Y coordinate of mana gauge in SystemGraphic
+    const static int ATB_GAUGE_SRC_X = 0;               //!< Source X coordinate of ATB gauge in SystemGraphic
+    const static int ATB_GAUGE_SRC_Y = 72;              //!< Source Y coordinate of ATB gauge in SystemGraphic
+    const static int BAR_WIDTH = 40;                    //!< Width of a bar Image
+    const static int MIN_GAUGE_WIDTH = 16;              //!< Narrowest variable-width gauge
+    const static int GAUGE_WIDTH_STEP = 4;              //!< Gauge widths derived from maximum health are multiples of this
+    const static int SLICE_BORDER = 3;                  //!< Width of the corners and edges kept when a gauge or bar is resized
+    const static int BAR_HEIGHT = 8;                    //!< Height of a bar Image
+    const static int HEALTH_BAR_A_SRC_X = 48;           //!< Source X coordinate of health bar A in SystemGraphic
+    const static int HEALTH_BAR_A_SRC_Y = 40;           //!< Source Y coordinate of health bar A in SystemGraphic
+    const static int MANA_BAR_A_SRC_X = 48;             //!< Source X coordinate of mana bar A in SystemGraphic
+    const static int MANA_BAR_A_SRC_Y = 56;             //!< Source Y coordinate of mana bar A in SystemGraphic
+    const static int ATB_BAR_A_SRC_X = 48;              //!< Source X coordinate of ATB bar A in SystemGraphic
+    const static int ATB_BAR_A_SRC_Y = 72;              //!< Source Y coordinate of ATB bar A in SystemGraphic
+    const static int HEALTH_BAR_B_SRC_X = 64;           //!< Source X coordinate of health bar B in SystemGraphic
+    const static int HEALTH_BAR_B_SRC_Y = 40;           //!< Source Y coordinate of health bar B in SystemGraphic
+    const static int MANA_BAR_B_SRC_X = 64;             //!< Source X coordinate of mana bar B in SystemGraphic
+    const static int MANA_BAR_B_SRC_Y = 56;             //!< Source Y coordinate of mana bar B in SystemGraphic
+    const static int ATB_BAR_B_SRC_X = 64;              //!< Source X coordinate of ATB bar B in SystemGraphic
+    const static int ATB_BAR_B_SRC_Y = 72;              //!< Source Y coordinate of ATB bar B in SystemGraphic
+    const static int DIGIT_WIDTH = 8;                   //!< Width of a digit Image
+    const static int DIGIT_HEIGHT = 16;                 //!< Height of a digit Image
+    const static int DIGIT_SRC_X = 0;                   //!< Source X coordinate of the first digit in SystemGraphic
+    const static int DIGIT_SRC_Y = 80;                  //!< Source Y coordinate of the first digit in SystemGraphic
+    const static int NUM_DIGITS = 10;                   //!< Amount of digit Images
+    const static int ATB_MAX = 300000;                  //!< ATB value at which a Battler's turn is ready
+    const static int FIXED_SHIFT = 8;                   //!< Number of fractional bits of fixed-point displayed values
+    const static int FIXED_ONE = 1 << FIXED_SHIFT;      //!< Fixed-point representation of 1
+    const static int RATE_SHIFT = 8;                    //!< Number of fractional bits of the animation rate (rate is in 1/256ths per frame)
+    const static int MIN_STEP = FIXED_ONE / 4;          //!< Smallest per-frame change of an animated value, so animations always settle
+    const static int FADE_INTERVAL = 2;                 //!< Frames between two steps of a fade
+    const static int FADE_STEP = 32;                    //!< Change of opacity per step of a fade
+    const static int OPAQUE = 255;                      //!< Opacity of a fully visible display
+    const static int MAX_CONDITIONS = 32;               //!< Number of status conditions tracked (conditions 1-32, one bit each in a condition mask)
+    const static int ICON_SIZE = 16;                    //!< Width and height of a status condition icon
+    const static int ICONS_PER_ROW = DISPLAY_WIDTH / ICON_SIZE;             //!< Number of icons in one row of the icon strip
+    const static int ICON_ROWS = 2;                     //!< Number of rows of the icon strip
+    const static int ICON_STRIP_HEIGHT = ICON_SIZE * ICON_ROWS;             //!< Height of the icon strip
+    const static int BLINK_TOGGLES = 6;                 //!< Number of times the icon of a newly inflicted condition is hidden or shown again
+    const static int MAX_TURNS = 99;                    //!< Highest turn count shown on a status condition icon
+    const static int COUNTER_SIZE = IMAGE_UNIT_SIZE;    //!< Width and height of a turn counter strip (two half-size digits)
+    const static int ZERO_PAIR_GLYPH = MAX_TURNS + 1;   //!< Index of the two-digit glyph "00"; "01"-"09" follow it, while glyphs 0-9 have no leading zero
+    const static int NUM_PAIR_GLYPHS = ZERO_PAIR_GLYPH + 10;                //!< Amount of two-digit glyphs (the turn counter strips plus "00"-"09")
+    const static int NUMBER_CELLS = 3;                  //!< Number of two-digit cells of a gauge number
+    const static int MAX_NUMBER = 999999;               //!< Highest value a gauge number can show
+    const static int NUMBER_X = DISPLAY_WIDTH - NUMBER_CELLS * COUNTER_SIZE;  //!< X coordinate of the first cell of a gauge number
+    const static int NO_GLYPH = -1;                     //!< Glyph index of an empty number cell
+    const static int STALE_GLYPH = -2;                  //!< Glyph index of a number cell which must be drawn again
+    const static int VARIANT_NORMAL = 0;                //!< Color variant: as in the SystemGraphic
+    const static int VARIANT_LOW = 1;                   //!< Color variant: red, for the health number of a Battler low on health
+    const static int VARIANT_GREY = 2;                  //!< Color variant: grey, for a Battler which is down
+    const static int VARIANT_FLASH = 3;                 //!< Color variant: brightened, for the health gauge right after a hit
+    const static int NUM_VARIANTS = 4;                  //!< Amount of color variants
+    const static int FLASH_FRAMES = 6;                  //!< Number of frames the health gauge flashes after a hit
+    const static int GAUGE_HEALTH = 0;                  //!< Index of the health gauge in arrays of gauge sprites
+    const static int GAUGE_MANA = 1;                    //!< Index of the mana gauge in arrays of gauge sprites
+    const static int GAUGE_ATB = 2;                     //!< Index of the ATB gauge in arrays of gauge sprites
+    const static int NUM_GAUGES = 3;                    //!< Amount of gauges
+    const static int ELEMENT_ICONS = NUM_GAUGES;        //!< Index of the icon strip in arrays of display elements (after the gauges)
+    const static int NUM_ELEMENTS = NUM_GAUGES + 1;     //!< Amount of display elements, stacked upwards in index order
+    const static int PANEL_HEIGHT = NUM_GAUGES * GAUGE_HEIGHT + ICON_STRIP_HEIGHT;  //!< Height of the background panel Image (all elements shown)
+    const static int COMMAND_GAUGE = 0;                 //!< Display list command: draw a gauge with its bar and damage ghost
+    const static int COMMAND_ICONS = 1;                 //!< Display list command: copy the icon strip
+    const static int BENCHMARK_ROUNDS = 1000;           //!< Number of times the benchmark draws every sprite with each kernel
+    const static int TUNE_ROUNDS = 200;                 //!< Number of times the auto-tuner draws every sprite of a class with each kernel
+    const static int MAX_SPRITES = NUM_GAUGES * 3 + NUM_DIGITS + MAX_CONDITIONS + NUM_PAIR_GLYPHS; //!< Number of Sprites in the atlas
+    const static int MAX_PATH_LENGTH = 260;             //!< Size of the buffers for file names read from the configuration
+    const static int MEMORY_ATLAS = 0;                  //!< Memory category: gauge, bar and digit Images copied from the SystemGraphic
+    const static int MEMORY_RUNS = 1;                   //!< Memory category: run-length encoded sprite data
+    const static int MEMORY_SURFACES = 2;               //!< Memory category: display surfaces and icon strips of the battle arena
+    const static int MEMORY_NUMBERS = 3;                //!< Memory category: cached turn counter strips
+    const static int MEMORY_ICONS = 4;                  //!< Memory category: the iconset
+    const static int MEMORY_SHADOW = 5;                 //!< Memory category: the shadow mode Image
+    const static int NUM_MEMORY_CATEGORIES = 6;         //!< Amount of memory categories
+    const static int MAX_FRAMES = 64;                   //!< Maximum number of cached gauge frame sets (one per kind and width)
+    const static int NUM_LAYER_TINTS = 4;               //!< Amount of tints the layers of a boss health gauge cycle through (tint 0 = untinted)
+    const static int NUM_FRAME_KINDS = NUM_GAUGES + NUM_LAYER_TINTS - 1;    //!< Kinds of cached frames: the gauges, then the tinted boss layers
+    const static int MAX_BOSSES = 32;                   //!< Maximum number of IDs read from BossMonsters
+    const static int MAX_MONSTER_ID = 9999;             //!< Highest monster database ID which can have settings of its own
+    const static int MAX_MONSTER_SETTINGS = 64;         //!< Maximum number of distinct monster settings, including the defaults
+    const static int MAX_POPUPS = 32;                   //!< Capacity of the popup pool; when it is full, the oldest popup is reused
+    const static int MAX_POPUP_DIGITS = 5;              //!< Highest number of digits of a popup (HP changes are below 100000)
+    const static int POPUP_RISE_SHIFT = 1;              //!< A popup rises one pixel every 2^POPUP_RISE_SHIFT frames
+    const static int POPUP_FADE_FRAMES = 8;             //!< Number of frames over which a popup fades out at the end of its life
+    const static int MAX_CHANGES = 8;                   //!< Number of separate HP changes kept per frame; further ones are merged into the last
+    const static int ALL_ELEMENTS = ( 1 << NUM_ELEMENTS ) - 1;              //!< Element mask with every display element
+
+    //! Display policy for heroes
+    /*!
+        A policy describes at compile time how the BattleDisplays of one side of the battle
+        behave: which elements they can show (on top of the layout) and where the display is put
+        relative to the Battler. The templated methods of BattleDisplay are instantiated once per
+        policy, so neither side branches on what kind of Battler it serves.
+    */
+    struct HeroPolicy
+    {
+
+        enum { ELEMENTS = ALL_ELEMENTS };               //!< Mask of the display elements heroes can show
+        enum { TRACK_ATB = 1 };                         //!< Whether the ATB value is read and shown
+        enum { PER_MONSTER = 0 };                       //!< Whether per-monster settings apply
+#ifdef DYNGAUGE_FIXED_LAYOUT
+        typedef ::HeroLayout Layout;                    //!< Layout generated for heroes
+#endif
+
+        //! X coordinate of the display on the Canvas, centering gauges of the given width
+        static int AnchorX( RPG::Battler * rBattlerPtr, int rGaugeWidth )
+        {
+
+            return rBattlerPtr->x - rGaugeWidth / 2;
+
+        }
+
+        //! Y coordinate of the display on the Canvas
+        static int AnchorY( RPG::Battler * rBattlerPtr )
+        {
+
+            return rBattlerPtr->y - DISPLAY_HEIGHT;
+
+        }
+
+        //! Whether the Battler is on screen
+        static bool Visible( RPG::Battler * )
+        {
+
+            return true;
+
+        }
+
+        //! Monster database ID of the Battler; heroes have none
+        static int DatabaseId( RPG::Battler * )
+        {
+
+            return 0;
+
+        }
+
+        //! Name of the side, for logs
+        static const char * Name()
+        {
+
+            return "hero";
+
+        }
+
+    };
+
+    //! Display policy for monsters
+    /*!
+        Monsters do not show an ATB gauge, as in the game's own battle screen, so their ATB value
+        is never read.
+    */
+    struct MonsterPolicy
+    {
+
+        enum { ELEMENTS = ALL_ELEMENTS & ~( 1 << GAUGE_ATB ) };     //!< Mask of the display elements monsters can show
+        enum { TRACK_ATB = 0 };                         //!< Whether the ATB value is read and shown
+        enum { PER_MONSTER = 1 };                       //!< Whether per-monster settings apply
+#ifdef DYNGAUGE_FIXED_LAYOUT
+        typedef ::MonsterLayout Layout;                 //!< Layout generated for monsters
+#endif
+
+        //! X coordinate of the display on the Canvas, centering gauges of the given width
+        static int AnchorX( RPG::Battler * rBattlerPtr, int rGaugeWidth )
+        {
+
+            return rBattlerPtr->x - rGaugeWidth / 2;
+
+        }
+
+        //! Y coordinate of the display on the Canvas
+        static int AnchorY( RPG::Battler * rBattlerPtr )
+        {
+
+            return rBattlerPtr->y - DISPLAY_HEIGHT;
+
+        }
+
+        //! Whether the Battler is on screen; monsters can be hidden until an event shows them
+        static bool Visible( RPG::Battler * rBattlerPtr )
+        {
+
+            return rBattlerPtr->notHidden;
+
+        }
+
+        //! Monster database ID of the Battler
+        static int DatabaseId( RPG::Battler * rBattlerPtr )
+        {
+
+            return static_cast<RPG::Monster *>( rBattlerPtr )->databaseId;
+
+        }
+
+        //! Name of the side, for logs
+        static const char * Name()
+        {
+
+            return "monster";
+
+        }
+
+    };
+
+    static RPG::Image * mHealthGaugePtr;                //!< Pointer to an Image of the health gauge
+    static RPG::Image * mManaGaugePtr;                  //!< Pointer to an Image of the mana gauge
+    static RPG::Image * mATBGaugePtr;                   //!< Pointer to an Image of the ATB gauge
+    static RPG::Image * mHealthBarAPtr;                 //!< Pointer to an Image of health bar A ("non-full")
+    static RPG::Image * mHealthBarBPtr;                 //!< Pointer to an Image of health bar B ("full")
+    static RPG::Image * mManaBarAPtr;                   //!< Pointer to an Image of mana bar A ("non-full")
+    static RPG::Image * mManaBarBPtr;                   //!< Pointer to an Image of mana bar B ("full")
+    static RPG::Image * mATBBarAPtr;                    //!< Pointer to an Image of ATB bar A ("non-full")
+    static RPG::Image * mATBBarBPtr;                    //!< Pointer to an Image of ATB bar B ("full")
+    static RPG::Image * mDigitPtr[NUM_DIGITS];          //!< Array of pointers to Image of numerical digits 0-9
+    static RPG::Image * mShadowPtr;                     //!< Pointer to the Image used for shadow mode full redraws (created on first use)
+    static RPG::Image * mIconSetPtr;                    //!< Pointer to the iconset atlas of status condition icons (NULL = no icons)
+    static RPG::Image * mCounterPtr[NUM_PAIR_GLYPHS];   //!< Array of pointers to cached two-digit glyphs: turn counter strips for 0-99, then "00"-"09"
+    static ImageArena mBattleArena;                     //!< Arena of the Images used during the current battle
+    static RPG::Image * mPanelPtr;                      //!< Pointer to the Image of the background panel (NULL = no panel)
+    static Sprite mGaugeSprite[NUM_GAUGES];             //!< Gauge frame Sprites
+    static Sprite mBarASprite[NUM_GAUGES];              //!< Bar A ("non-full") Sprites
+    static Sprite mBarBSprite[NUM_GAUGES];              //!< Bar B ("full") Sprites
+    static Sprite mDigitSprite[NUM_DIGITS];             //!< Digit Sprites 0-9
+    static Sprite mIconSprite[MAX_CONDITIONS];          //!< Status condition icon Sprites
+    static Sprite mCounterSprite[NUM_PAIR_GLYPHS];      //!< Two-digit glyph Sprites
+
+    //! Default constructor
+    /*!
+        The default constructor of BattleDisplay provides an empty instance.
+    */
+    BattleDisplay()
+    {
+
+        int i;                  // Index variable
+
+        // Initialize variables
+        mBattlerPtr = NULL;
+        mCurHealth = 0;
+        mMaxHealth = 0;
+        mCurMana = 0;
+        mMaxMana = 0;
+        mCurATB = 0;
+        mGhostTimer.SetCallback( OnGhostTimer, this );
+        mFlashTimer.SetCallback( OnFlashTimer, this );
+        mFlashing = false;
+        mDrawnVariants = -1;
+        mPanelTop = DISPLAY_HEIGHT;
+        mGaugeWidth = GAUGE_WIDTH;
+        mOffsetX = 0;
+        mOffsetY = 0;
+        mAnchored = false;
+        for( i = 0; i < NUM_GAUGES; i++ )
+        {   // The standard frames are the first ones of the cache
+
+            mFramesPtr[i] = &mFrames[i];
+
+        }
+        for( i = 0; i < NUM_LAYER_TINTS; i++ )
+        {
+
+            mLayerFramesPtr[i] = &mFrames[GAUGE_HEALTH];
+
+        }
+        mLayerHealth = 0;
+        mTopLayer = 0;
+        mSplitHealth = -1;
+        mLayer = 0;
+        mLayersLeft = 0;
+        mLayerValue = 0;
+        mLayerMax = 0;
+        mLayerGhost = 0;
+        mFadeTimer.SetCallback( OnFadeTimer, this );
+        mAlpha = 0;
+        mTargetAlpha = 0;
+        mBlinkTimer.SetCallback( OnBlinkTimer, this );
+        mConditionMask = 0;
+        mBlinkMask = 0;
+        mBlinkHidden = false;
+        mBlinkCount = 0;
+        mStripMask = 0;
+        mDrawnIconMask = 0;
+        mMaxATB = ATB_MAX;
+        mNoGhost = 0;
+        mElements = ALL_ELEMENTS;
+        mObservedHealth = mCurHealth;
+        mNumChanges = 0;
+        mNumCommands = 0;
+        mCompiledVersion = -1;
+        mTurnsChanged = false;
+        memset( mConditionTurns, 0, sizeof( mConditionTurns ) );
+        Settle();
+        mShadowPhase = mNextShadowPhase++;
+        // The Images come from the battle arena once a Battler is set
+        mDisplayPtr = NULL;
+        mIconStripPtr = NULL;
+        Invalidate();
+
+    }
+
+    //! Constructor
+    /*!
+        This constructor creates a BattleDisplay for a given Battler.
+
+        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler which this BattleDisplay will serve
+    */
+    BattleDisplay( RPG::Battler * rBattlerPtr )
+    {
+
+        int i;                  // Index variable
+
+        // Initialize variables
+        mBattlerPtr = rBattlerPtr;
+        mCurHealth = mBattlerPtr->hp;
+        mMaxHealth = mBattlerPtr->getMaxHp();
+        mCurMana = mBattlerPtr->mp;
+        mMaxMana = mBattlerPtr->getMaxMp();
+        mCurATB = mBattlerPtr->atbValue;
+        mGhostTimer.SetCallback( OnGhostTimer, this );
+        mFlashTimer.SetCallback( OnFlashTimer, this );
+        mFlashing = false;
+        mDrawnVariants = -1;
+        mPanelTop = DISPLAY_HEIGHT;
+        mGaugeWidth = GAUGE_WIDTH;
+        mOffsetX = 0;
+        mOffsetY = 0;
+        mAnchored = false;
+        for( i = 0; i < NUM_GAUGES; i++ )
+        {   // The standard frames are the first ones of the cache
+
+            mFramesPtr[i] = &mFrames[i];
+
+        }
+        for( i = 0; i < NUM_LAYER_TINTS; i++ )
+        {
+
+            mLayerFramesPtr[i] = &mFrames[GAUGE_HEALTH];
+
+        }
+        mLayerHealth = 0;
+        mTopLayer = 0;
+        mSplitHealth = -1;
+        mLayer = 0;
+        mLayersLeft = 0;
+        mLayerValue = 0;
+        mLayerMax = 0;
+        mLayerGhost = 0;
+        mFadeTimer.SetCallback( OnFadeTimer, this );
+        mAlpha = 0;
+        mTargetAlpha = 0;
+        mBlinkTimer.SetCallback( OnBlinkTimer, this );
+        mConditionMask = 0;
+        mBlinkMask = 0;
+        mBlinkHidden = false;
+        mBlinkCount = 0;
+        mStripMask = 0;
+        mDrawnIconMask = 0;
+        mMaxATB = ATB_MAX;
+        mNoGhost = 0;
+        mElements = ALL_ELEMENTS;
+        mObservedHealth = mCurHealth;
+        mNumChanges = 0;
+        mNumCommands = 0;
+        mCompiledVersion = -1;
+        mTurnsChanged = false;
+        memset( mConditionTurns, 0, sizeof( mConditionTurns ) );
+        Settle();
+        mShadowPhase = mNextShadowPhase++;
+        // The Images come from the battle arena once a Battler is set
+        mDisplayPtr = NULL;
+        mIconStripPtr = NULL;
+        Invalidate();
+
+    }
+
+    //! Destructor
+    /*!
+        The destructor of BattleDisplay deletes all member objects and the BattleDisplay object
+        itself. Its Images belong to the battle arena, which destroys them.
+    */
+    ~BattleDisplay()
+    {
+
+        // Make sure the timer wheel does not point to this BattleDisplay anymore
+        mTimerWheel.Cancel( mGhostTimer );
+        mTimerWheel.Cancel( mFadeTimer );
+        mTimerWheel.Cancel( mBlinkTimer );
+        mTimerWheel.Cancel( mFlashTimer );
+        // Note that since mBattlerPtr merely points to a Battler object which exists outside of
+        // the context of this plugin, it does not have to (nor should it) be deleted/destroyed.
+
+    }
+
+    //! Sets the Battler
+    /*!
+        SetBattler() sets the value of mBattlerPtr to the given parameter and initializes related
+        variables according to the Battler's data. Policy (HeroPolicy or MonsterPolicy) must be the
+        same one Update() is called with.
+
+        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler which this BattleDisplay will serve
+    */
+    template <class Policy>
+    void SetBattler( RPG::Battler * rBattlerPtr )
+    {
+
+        // If necessary, initialize static members
+        if( !mInitialized )
+        {
+
+            InitializeStatic();
+
+        }
+        if( !AcquireImages() )
+        {   // Arena is full; leave this Battler without a display
+
+            Release();
+            return;
+
+        }
+        // Initialize variables
+        mBattlerPtr = rBattlerPtr;
+        mCurHealth = rBattlerPtr->hp;
+        mMaxHealth = mBattlerPtr->getMaxHp();
+        mCurMana = mBattlerPtr->mp;
+        mMaxMana = mBattlerPtr->getMaxMp();
+        mCurATB = Policy::TRACK_ATB ? mBattlerPtr->atbValue : 0;
+        mObservedHealth = mCurHealth;
+        mNumChanges = 0;
+        const MonsterSettings & settings = Policy::PER_MONSTER ? SettingsFor( Policy::DatabaseId( mBattlerPtr ) ) : mMonsterSettings[0];
+#ifdef DYNGAUGE_FIXED_LAYOUT
+        mElements = Policy::ELEMENTS;
+#else
+        mElements = Policy::ELEMENTS & settings.mElements;
+#endif
+        mOffsetX = settings.mOffsetX;
+        mOffsetY = settings.mOffsetY;
+        mAnchored = Policy::PER_MONSTER && mAnchorToSprite && AnchorToSprite( Policy::DatabaseId( mBattlerPtr ) );
+        SetLayers( settings.mLayers );
+        SetGaugeWidth( ( 0 < settings.mGaugeWidth ) ? settings.mGaugeWidth : GaugeWidthFor( mMaxHealth ) );
+        mConditionMask = ConditionMask( mBattlerPtr );
+        memset( mConditionTurns, 0, sizeof( mConditionTurns ) );
+        // A new Battler is shown as it is, not animated from the previous one's values
+        Settle();
+        // A new Battler means nothing on the display Image can be trusted, and may have a
+        // different layout
+        CompileDisplayList();
+        // Fade in from invisible
+        mAlpha = 0;
+        FadeTo( OPAQUE );
+
+    }
+
+    //! Releases the Battler
+    /*!
+        Release() detaches the BattleDisplay from its Battler, for slots which are unused in the
+        current battle and at the end of a battle; Update() does nothing until SetBattler() is
+        called again. The Images stay valid until the battle arena is reset.
+    */
+    void Release()
+    {
+
+        mBattlerPtr = NULL;
+        mTimerWheel.Cancel( mGhostTimer );
+        mTimerWheel.Cancel( mFadeTimer );
+        mTimerWheel.Cancel( mBlinkTimer );
+        mTimerWheel.Cancel( mFlashTimer );
+
+    }
+
+    //! Ends the battle
+    /*!
+        EndBattle() releases the given BattleDisplays and gives all Images of the battle back to
+        the battle arena at once.
+
+        \param rDisplays : (BattleDisplay *) Array of BattleDisplays
+        \param rCount : (int) Number of BattleDisplays in the array
+    */
+    static void EndBattle( BattleDisplay * rDisplays, int rCount )
+    {
+
+        BattleDisplay * displayPtr;     // Current BattleDisplay
+
+        for( displayPtr = rDisplays; displayPtr < rDisplays + rCount; displayPtr++ )
+        {
+
+            displayPtr->Release();
+            displayPtr->mDisplayPtr = NULL;
+            displayPtr->mIconStripPtr = NULL;
+
+        }
+
+    }
+
+    //! Updates the BattleDisplay
+    /*!
+        Update() recalculates values based on past and present data and calls Draw() to refresh the
+        appearance of the BattleDisplay. Displayed health and mana approach the Battler's values
+        gradually; Draw() is only called while something is changing, so a settled display costs
+        nothing but the comparisons. Policy decides at compile time what is read from the Battler.
+        The display Image is put on the Canvas by Show().
+    */
+    template <class Policy>
+    void Update()
+    {
+
+        bool changed;           // Whether anything displayed changed this frame
+        unsigned int mask;      // Current condition mask of the Battler
+
+        // Nothing to do if no Battler has been assigned
+        if( NULL == mBattlerPtr )
+        {
+
+            return;
+
+        }
+        // Update variables; after Invalidate() a redraw is pending regardless of changes
+        changed = mInvalid || mCompiledVersion != mLayoutVersion;
+        if( 0 < mGhostDelay && mBattlerPtr->hp < mCurHealth )
+        {   // Health was lost; the ghost holds the health shown before the first hit
+
+            if( !mGhostActive )
+            {
+
+                mGhostActive = true;
+                mGhostHealth = mShownHealth;
+
+            }
+            // Every further hit restarts the delay
+            mGhostDecaying = false;
+            mTimerWheel.Schedule( mGhostTimer, mGhostDelay );
+
+        }
+        if( mFlashOnHit && mBattlerPtr->hp < mCurHealth )
+        {
+
+            mFlashing = true;
+            mTimerWheel.Schedule( mFlashTimer, FLASH_FRAMES );
+
+        }
+        // All HP changes since the last frame are applied as one; only the popups may show them
+        // one by one
+        ObserveHealth();
+        if( 0 < mNumChanges )
+        {
+
+            ShowChanges();
+            mNumChanges = 0;
+
+        }
+        mCurHealth = mBattlerPtr->hp;
+        mCurMana = mBattlerPtr->mp;
+        // Fade out when the Battler falls, and back in when revived
+        FadeTo( ( 0 < mCurHealth ) ? OPAQUE : 0 );
+        if( mMaxHealth != mBattlerPtr->getMaxHp() || mMaxMana != mBattlerPtr->getMaxMp() )
+        {
+
+            mMaxHealth = mBattlerPtr->getMaxHp();
+            mMaxMana = mBattlerPtr->getMaxMp();
+            changed = true;
+
+        }
+        if( Policy::TRACK_ATB && mCurATB != mBattlerPtr->atbValue )
+        {
+
+            mCurATB = mBattlerPtr->atbValue;
+            changed = true;
+
+        }
+        // Status conditions: battle events can inflict or cure them outside of any action, so
+        // the conditions are read every frame; everything past that is skipped unless the mask
+        // changed
+        mask = ConditionMask( mBattlerPtr );
+        if( mask != mConditionMask )
+        {
+
+            if( 0 < mBlinkInterval && 0 != ( mask & ~mConditionMask ) )
+            {   // Newly inflicted conditions blink for a while
+
+                mBlinkMask = ( mBlinkMask | ( mask & ~mConditionMask ) ) & mask;
+                mBlinkCount = BLINK_TOGGLES;
+                mTimerWheel.Schedule( mBlinkTimer, mBlinkInterval );
+
+            }
+            mBlinkMask &= mask;
+            // Counters start over for inflicted conditions and stop for cured ones; only the
+            // changed bits are visited
+            ResetTurns( mask ^ mConditionMask );
+            mConditionMask = mask;
+
+        }
+        if( !Settled() )
+        {
+
+            changed = true;
+
+        }
+        // Advance the animations; note that both must be advanced every frame
+        changed = Approach( mShownHealth, mCurHealth ) | changed;
+        changed = Approach( mShownMana, mCurMana ) | changed;
+        if( mGhostActive )
+        {
+
+            if( mGhostDecaying )
+            {
+
+                changed = Approach( mGhostHealth, mShownHealth >> FIXED_SHIFT ) | changed;
+
+            }
+            if( ( mGhostDecaying && mGhostHealth <= mShownHealth ) || ( mCurHealth << FIXED_SHIFT ) >= mGhostHealth )
+            {   // Ghost has caught up with the displayed health, or the lost health was healed
+
+                CancelGhost();
+                changed = true;
+
+            }
+
+        }
+        // Refresh display only while something is in flight
+        if( changed )
+        {
+
+            Draw<Policy>();
+
+        }
+        // In shadow mode, periodically check the incremental result against a full redraw
+        if( 0 < mShadowInterval && 0 == ( mFrameCount + mShadowPhase ) % mShadowInterval )
+        {
+
+            VerifyShadow<Policy>();
+
+        }
+
+    }
+
+    //! Puts the BattleDisplay on the Canvas
+    /*!
+        Show() draws the display Image, and the panel behind it, at the Battler's position, and
+        then the Battler's popups. It is called right after the Battler is drawn, so the display
+        is layered with the Battler it belongs to and windows, animations and messages drawn
+        later stay on top of it. Policy decides at compile time where the display is put and
+        whether the Battler is on screen.
+    */
+    template <class Policy>
+    void Show()
+    {
+
+        if( NULL != mBattlerPtr && 0 < mAlpha && Policy::Visible( mBattlerPtr ) )
+        {
+
+            if( NULL != mPanelPtr && mPanelTop < DISPLAY_HEIGHT )
+            {   // The engine blends the panel with the battle scene behind it
+
+                mPanelPtr->alpha = mPanelOpacity * mAlpha / OPAQUE;
+                RPG::screen->canvas->draw( Policy::AnchorX( mBattlerPtr, mGaugeWidth ) + mOffsetX, Policy::AnchorY( mBattlerPtr ) + mOffsetY + mPanelTop,
+                                           mPanelPtr, 0, 0, PanelWidth(), DISPLAY_HEIGHT - mPanelTop );
+
+            }
+            mDisplayPtr->alpha = mAlpha;
+            RPG::screen->canvas->draw( Policy::AnchorX( mBattlerPtr, mGaugeWidth ) + mOffsetX, Policy::AnchorY( mBattlerPtr ) + mOffsetY, mDisplayPtr );
+
+        }
+        ShowPopups();
+
+    }
+
+    //! Updates the BattleDisplays of one side
+    /*!
+        UpdateAll() calls Update() for every BattleDisplay of an array; unused BattleDisplays
+        return right away.
+
+        \param rDisplays : (BattleDisplay *) Array of BattleDisplays
+        \param rCount : (int) Number of BattleDisplays in the array
+    */
+    template <class Policy>
+    static void UpdateAll( BattleDisplay * rDisplays, int rCount )
+    {
+
+        BattleDisplay * displayPtr;     // Current BattleDisplay
+
+        for( displayPtr = rDisplays; displayPtr < rDisplays + rCount; displayPtr++ )
+        {
+
+            displayPtr->Update<Policy>();
+
+        }
+
+    }
+
+    //! Checks that monster displays could be anchored to their graphics
+    /*!
+        CheckAnchors() is called after the monster displays of a battle were set up. If
+        AnchorToSprite is on but not a single monster graphic of the battle could be measured,
+        the setting has no effect, which is most likely a problem with the game's files rather
+        than intended; the graphics are then listed in DynGauge_sprites.txt. The check is done
+        for the first battle with monsters only.
+
+        \param rDisplays : (BattleDisplay *) Array of monster BattleDisplays
+        \param rCount : (int) Number of BattleDisplays in the array
+    */
+    static void CheckAnchors( BattleDisplay * rDisplays, int rCount )
+    {
+
+        BattleDisplay * displayPtr;     // Current BattleDisplay
+        RPG::DBMonster * monsterPtr;    // Database entry of the current monster
+        int monsters;                   // Number of monsters in the battle
+
+        if( !mAnchorToSprite || mAnchorsChecked )
+        {
+
+            return;
+
+        }
+        monsters = 0;
+        for( displayPtr = rDisplays; displayPtr < rDisplays + rCount; displayPtr++ )
+        {
+
+            if( NULL != displayPtr->mBattlerPtr )
+            {
+
+                if( displayPtr->mAnchored )
+                {
+
+                    mAnchorsChecked = true;
+                    return;
+
+                }
+                monsters++;
+
+            }
+
+        }
+        if( 0 == monsters )
+        {
+
+            return;
+
+        }
+        mAnchorsChecked = true;
+        std::ofstream log( "DynGauge_sprites.txt", std::ios::app );    // Log file
+        log << "Frame " << mFrameCount << ": no monster graphic could be measured, so AnchorToSprite has no effect."
+            << " Graphics are looked for as PNG or BMP files in Monster and in the Monster folder of the RTP (RtpPath):";
+        for( displayPtr = rDisplays; displayPtr < rDisplays + rCount; displayPtr++ )
+        {
+
+            if( NULL != displayPtr->mBattlerPtr )
+            {
+
+                monsterPtr = RPG::dbMonsters[MonsterPolicy::DatabaseId( displayPtr->mBattlerPtr )];
+                log << " " << ( ( NULL != monsterPtr ) ? monsterPtr->filename.s_str() : std::string( "?" ) );
+
+            }
+
+        }
+        log << std::endl;
+        log.close();
+
+    }
+
+    //! Observes the HP of the Battlers
+    /*!
+        ObserveAll() records HP changes of every BattleDisplay of an array without updating
+        anything else. It is meant for events which can happen several times per frame; the
+        changes are applied together by the next Update().
+
+        \param rDisplays : (BattleDisplay *) Array of BattleDisplays
+        \param rCount : (int) Number of BattleDisplays in the array
+    */
+    static void ObserveAll( BattleDisplay * rDisplays, int rCount )
+    {
+
+        BattleDisplay * displayPtr;     // Current BattleDisplay
+
+        for( displayPtr = rDisplays; displayPtr < rDisplays + rCount; displayPtr++ )
+        {
+
+            if( NULL != displayPtr->mBattlerPtr )
+            {
+
+                displayPtr->ObserveHealth();
+
+            }
+
+        }
+
+    }
+
+    //! Ages all popups
+    /*!
+        AgePopups() ages every popup of the pool by one frame. It is called once per frame, after
+        the Battlers and their popups were drawn.
+    */
+    static void AgePopups()
+    {
+
+        Popup * popupPtr;       // Current popup
+
+        for( popupPtr = mPopup; popupPtr < mPopup + MAX_POPUPS; popupPtr++ )
+        {
+
+            if( popupPtr->mAge < mPopupFrames )
+            {
+
+                popupPtr->mAge++;
+
+            }
+
+        }
+
+    }
+
+    //! Puts the popups of the BattleDisplay on the Canvas
+    /*!
+        ShowPopups() draws the live popups spawned by this BattleDisplay. It is called from Show(),
+        so the popups are layered with their Battler like the display. The digit Images are
+        shared with the displays, so their opacity is restored after each popup.
+    */
+    void ShowPopups() const
+    {
+
+        const Popup * popupPtr; // Current popup
+        int digit;              // Index variable
+        int x, y;               // Position of the current digit on the Canvas
+        int alpha;              // Opacity of the current popup
+
+        for( popupPtr = mPopup; popupPtr < mPopup + MAX_POPUPS; popupPtr++ )
+        {
+
+            if( popupPtr->mAge >= mPopupFrames || this != popupPtr->mOwnerPtr )
+            {
+
+                continue;
+
+            }
+            alpha = ( mPopupFrames - popupPtr->mAge ) * OPAQUE / POPUP_FADE_FRAMES;
+            x = popupPtr->mX - popupPtr->mNumDigits * DIGIT_WIDTH / 2;
+            y = popupPtr->mY - ( popupPtr->mAge >> POPUP_RISE_SHIFT );
+            for( digit = 0; digit < popupPtr->mNumDigits; digit++ )
+            {
+
+                mDigitPtr[popupPtr->mDigit[digit]]->alpha = ( alpha < OPAQUE ) ? alpha : OPAQUE;
+                RPG::screen->canvas->draw( x + digit * DIGIT_WIDTH, y, mDigitPtr[popupPtr->mDigit[digit]] );
+                mDigitPtr[popupPtr->mDigit[digit]]->alpha = OPAQUE;
+
+            }
+
+        }
+
+    }
+
+    //! Removes all popups
+    static void ClearPopups()
+    {
+
+        Popup * popupPtr;       // Current popup
+
+        for( popupPtr = mPopup; popupPtr < mPopup + MAX_POPUPS; popupPtr++ )
+        {
+
+            popupPtr->mAge = mPopupFrames;
+
+        }
+
+    }
+
+    //! Counts a turn of the Battler
+    /*!
+        OnTurn() is called when the Battler starts an action and increases the turn counters of
+        all status conditions it currently has. Only the set bits of the condition mask are
+        visited, so the cost does not depend on how many conditions exist.
+    */
+    void OnTurn()
+    {
+
+        unsigned int mask;      // Conditions whose counters have not been increased yet
+        int condition;          // Zero-based index of the condition
+
+        for( mask = mConditionMask; 0 != mask; mask &= mask - 1 )
+        {
+
+            condition = __builtin_ctz( mask );
+            if( mConditionTurns[condition] < MAX_TURNS )
+            {
+
+                mConditionTurns[condition]++;
+                mTurnsChanged = true;
+
+            }
+
+        }
+
+    }
+
+    //! Gets a turn counter
+    /*!
+        ConditionTurns() tells for how many of the Battler's turns a status condition has lasted.
+
+        \param rCondition : (int) One-based ID of the status condition
+        \return (int) Number of turns, or 0 if the Battler does not have the condition
+    */
+    int ConditionTurns( int rCondition )
+    {
+
+        if( rCondition < 1 || rCondition > MAX_CONDITIONS )
+        {
+
+            return 0;
+
+        }
+        return mConditionTurns[rCondition - 1];
+
+    }
+
+    //! Checks whether this BattleDisplay serves a Battler
+    /*!
+        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler
+        \return (bool) true if this BattleDisplay was assigned the Battler
+    */
+    bool Serves( RPG::Battler * rBattlerPtr )
+    {
+
+        return rBattlerPtr == mBattlerPtr;
+
+    }
+
+    //! Measures the memory held by DynGauge
+    /*!
+        MeasureMemory() adds up the bytes DynGauge holds, by category. Images count with their
+        pixels only.
+
+        \param rBytes : (int *) Array of NUM_MEMORY_CATEGORIES sizes to fill
+        \return (int) Total number of bytes
+    */
+    static int MeasureMemory( int * rBytes )
+    {
+
+        int i;                  // Index variable
+        int total;              // Sum of all categories
+
+        rBytes[MEMORY_ATLAS] = NUM_GAUGES * ( GAUGE_WIDTH * GAUGE_HEIGHT + 2 * BAR_WIDTH * BAR_HEIGHT )
+                               + NUM_DIGITS * DIGIT_WIDTH * DIGIT_HEIGHT;
+        for( i = NUM_GAUGES; i < mNumFrames; i++ )
+        {   // Frames of other widths
+
+            rBytes[MEMORY_ATLAS] += mFrames[i].mWidth * ( GAUGE_HEIGHT + 2 * BAR_HEIGHT );
+
+        }
+        rBytes[MEMORY_RUNS] = RLESprite::PoolBytes();
+        rBytes[MEMORY_SURFACES] = mBattleArena.Bytes( false ) + ( ( NULL == mPanelPtr ) ? 0 : DISPLAY_WIDTH * PANEL_HEIGHT );
+        rBytes[MEMORY_NUMBERS] = 0;
+        for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+        {
+
+            if( NULL != mCounterPtr[i] )
+            {
+
+                rBytes[MEMORY_NUMBERS] += COUNTER_SIZE * COUNTER_SIZE;
+
+            }
+
+        }
+        rBytes[MEMORY_ICONS] = ( NULL == mIconSetPtr ) ? 0 : mIconSetPtr->width * mIconSetPtr->height;
+        rBytes[MEMORY_SHADOW] = ( NULL == mShadowPtr ) ? 0 : DISPLAY_WIDTH * DISPLAY_HEIGHT;
+        total = 0;
+        for( i = 0; i < NUM_MEMORY_CATEGORIES; i++ )
+        {
+
+            total += rBytes[i];
+
+        }
+        return total;
+
+    }
+
+    //! Keeps the memory within the budget
+    /*!
+        EnforceBudget() evicts from the caches while DynGauge holds more than MemoryBudget. It is
+        called whenever a cache grows, and at the end of each battle. The caches are evicted from
+        in this order: gauge frames composed for other widths which are not used in this battle;
+        between battles only, the turn counter glyph strips and the iconset; free surfaces of the
+        battle arena; and the shadow mode Image. The glyph strips and the iconset are restored
+        when they are drawn next, the shadow mode Image when it is needed, and everything else
+        when it is acquired again. Images in use are never evicted, so the budget can still be
+        exceeded during a battle with many Battlers.
+
+        \param rBetweenBattles : (bool) Whether no battle is running, so nothing is drawn until the next one
+        \return (int) Number of bytes evicted
+    */
+    static int EnforceBudget( bool rBetweenBattles )
+    {
+
+        int bytes[NUM_MEMORY_CATEGORIES];      // Bytes per category
+        int excess;             // Number of bytes over the budget
+        int evicted;            // Number of bytes evicted
+        int i;                  // Index variable
+
+        if( 0 >= mMemoryBudget )
+        {
+
+            return 0;
+
+        }
+        excess = MeasureMemory( bytes ) - mMemoryBudget;
+        evicted = 0;
+        for( i = mNumFrames - 1; NUM_GAUGES <= i && evicted < excess; i-- )
+        {
+
+            if( 0 < mFrames[i].mWidth && mBattleArena.Generation() != mFrames[i].mUsedIn )
+            {
+
+                evicted += mFrames[i].mWidth * ( GAUGE_HEIGHT + 2 * BAR_HEIGHT );
+                FreeFrames( mFrames[i] );
+
+            }
+
+        }
+        if( rBetweenBattles && evicted < excess && 0 < bytes[MEMORY_NUMBERS] )
+        {
+
+            for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+            {
+
+                RPG::Image::destroy( mCounterPtr[i] );
+                mCounterPtr[i] = NULL;
+
+            }
+            evicted += bytes[MEMORY_NUMBERS];
+
+        }
+        if( rBetweenBattles && evicted < excess && NULL != mIconSetPtr )
+        {
+
+            RPG::Image::destroy( mIconSetPtr );
+            mIconSetPtr = NULL;
+            mIconSetEvicted = true;
+            evicted += bytes[MEMORY_ICONS];
+
+        }
+        if( evicted < excess )
+        {
+
+            evicted += mBattleArena.Trim( excess - evicted );
+
+        }
+        if( evicted < excess && NULL != mShadowPtr )
+        {
+
+            RPG::Image::destroy( mShadowPtr );
+            mShadowPtr = NULL;
+            evicted += DISPLAY_WIDTH * DISPLAY_HEIGHT;
+
+        }
+        mEvictedBytes += evicted;
+        return evicted;
+
+    }
+
+    //! Restores evicted caches which are drawn from
+    /*!
+        RestoreCaches() builds the turn counter glyph strips and loads the iconset again if
+        EnforceBudget() evicted them. Their Sprites keep their encoding, since the pixels are the
+        same as before.
+    */
+    static void RestoreCaches()
+    {
+
+        int i;                  // Index variable
+
+        if( !mInitialized )
+        {
+
+            return;
+
+        }
+        if( NULL == mCounterPtr[0] )
+        {
+
+            BuildCounters();
+            for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+            {
+
+                mCounterSprite[i].Rebind( mCounterPtr[i] );
+
+            }
+
+        }
+        if( mIconSetEvicted )
+        {
+
+            mIconSetEvicted = false;
+            LoadIconSet();
+            for( i = 0; i < MAX_CONDITIONS; i++ )
+            {
+
+                if( mIconSprite[i].IsBuilt() )
+                {
+
+                    mIconSprite[i].Rebind( mIconSetPtr );
+
+                }
+
+            }
+
+        }
+
+    }
+
+    //! Writes the memory report
+    /*!
+        WriteMemoryReport() appends the bytes per category to DynGauge_memory.txt.
+
+        \param rWhen : (const char *) Occasion of the report, for the log
+    */
+    static void WriteMemoryReport( const char * rWhen )
+    {
+
+        const static char * NAMES[NUM_MEMORY_CATEGORIES] = { "atlas", "sprite runs", "surfaces", "counter cache", "iconset", "shadow" };
+
+        int i;                  // Index variable
+        int bytes[NUM_MEMORY_CATEGORIES];      // Bytes per category
+        int total;              // Sum of all categories
+        std::ofstream report( "DynGauge_memory.txt", std::ios::app );     // Report file
+
+        total = MeasureMemory( bytes );
+        report << "Frame " << mFrameCount << " (" << rWhen << "):" << std::endl;
+        for( i = 0; i < NUM_MEMORY_CATEGORIES; i++ )
+        {
+
+            report << "  " << NAMES[i] << ": " << bytes[i] << " bytes" << std::endl;
+
+        }
+        report << "  total: " << total << " bytes";
+        if( 0 < mMemoryBudget )
+        {
+
+            report << " of " << mMemoryBudget << " budget, " << mEvictedBytes << " evicted so far";
+
+        }
+        report << std::endl;
+        report.close();
+
+    }
+
+    //! Handles the end of a battle for memory
+    /*!
+        OnBattleEnd() is called after the battle arena was reset: the surfaces of the battle are
+        now free, so this is where the budget is enforced and, if MemoryReport is enabled, the
+        report written. Popups still in flight are dropped. Graphics measured for this battle are
+        added to the sprite cache file.
+    */
+    static void OnBattleEnd()
+    {
+
+        ClearPopups();
+        EnforceBudget( true );
+        ReportMemory( "battle end" );
+        SpriteMetrics::Save();
+
+    }
+
+    //! Writes the memory report, if it is enabled
+    /*!
+        \param rWhen : (const char *) Occasion of the report, for the log
+    */
+    static void ReportMemory( const char * rWhen )
+    {
+
+        if( mMemoryReport )
+        {
+
+            WriteMemoryReport( rWhen );
+
+        }
+
+    }
+
+    //! Destroys the cached gauge frames
+    /*!
+        DestroyFrames() destroys the Images of the gauge frames composed for other widths than
+        the standard one, which belong to the atlas and are destroyed with it.
+    */
+    static void DestroyFrames()
+    {
+
+        int i;                  // Index variable
+
+        for( i = NUM_GAUGES; i < mNumFrames; i++ )
+        {
+
+            if( 0 < mFrames[i].mWidth )
+            {
+
+                FreeFrames( mFrames[i] );
+
+            }
+
+        }
+        mNumFrames = NUM_GAUGES;
+
+    }
+
+    //! Advances the frame count
+    /*!
+        Tick() is called once per frame of the game loop and keeps the frame count used for
+        time-based behavior of all BattleDisplays.
+    */
+    static void Tick()
+    {
+
+        mFrameCount++;
+        // Run the effects which are due this frame
+        mTimerWheel.Advance();
+
+    }
+
+    //! Configures the class
+    /*!
+        Configure() reads the settings shared by all BattleDisplays from the plugin configuration.
+
+        \param rConfiguration : (std::map<std::string, std::string> &) Configuration data from the DynRPG.ini file
+    */
+    static void Configure( std::map<std::string, std::string> & rConfiguration )
+    {
+
+        mShadowInterval = atoi( rConfiguration["ShadowCheckInterval"].c_str() );
+        // Animation rate in 1/256ths of the remaining distance per frame; 0 or 256+ means no animation
+        mAnimationRate = rConfiguration["GaugeRate"].empty() ? 32 : atoi( rConfiguration["GaugeRate"].c_str() );
+        if( mAnimationRate <= 0 || mAnimationRate > ( 1 << RATE_SHIFT ) )
+        {
+
+            mAnimationRate = 1 << RATE_SHIFT;
+
+        }
+        // Frames before the damage ghost starts to decay; 0 means no damage ghost
+        mGhostDelay = rConfiguration["GhostDelay"].empty() ? 30 : atoi( rConfiguration["GhostDelay"].c_str() );
+        if( mGhostDelay < 0 )
+        {
+
+            mGhostDelay = 0;
+
+        }
+        if( mGhostDelay > TimerWheel::MAX_DELAY )
+        {
+
+            mGhostDelay = TimerWheel::MAX_DELAY;
+
+        }
+        // Iconset with the status condition icons (condition N at index N-1, left to right, top
+        // to bottom); it must use the same palette as the System2 graphic
+        CopySetting( mIconSetFile, rConfiguration["IconSet"], "Picture\\DynGaugeIcons.png" );
+        // Frames between two blinks of a new condition's icon; 0 means no blinking
+        mBlinkInterval = rConfiguration["IconBlinkFrames"].empty() ? 8 : atoi( rConfiguration["IconBlinkFrames"].c_str() );
+        mShowCounters = ( "false" != rConfiguration["ShowCounters"] );
+        // Layout: which elements are shown
+        mShowElement[GAUGE_HEALTH] = ( "false" != rConfiguration["ShowHealth"] );
+        mShowElement[GAUGE_MANA] = ( "false" != rConfiguration["ShowMana"] );
+        mShowElement[GAUGE_ATB] = ( "false" != rConfiguration["ShowATB"] );
+        mShowElement[ELEMENT_ICONS] = ( "false" != rConfiguration["ShowIcons"] );
+        mShowNumbers = ( "true" == rConfiguration["ShowNumbers"] );
+        // Color variants
+        mLowHealthPercent = rConfiguration["LowHealthPercent"].empty() ? 25 : atoi( rConfiguration["LowHealthPercent"].c_str() );
+        mFlashOnHit = ( "false" != rConfiguration["FlashOnHit"] );
+        // Background panel; the color is given in hex as RRGGBB
+        mPanelOpacity = atoi( rConfiguration["PanelOpacity"].c_str() );
+        if( mPanelOpacity > OPAQUE )
+        {
+
+            mPanelOpacity = OPAQUE;
+
+        }
+        mPanelColor = static_cast<int>( strtol( rConfiguration["PanelColor"].c_str(), NULL, 16 ) ) & 0xFFFFFF;
+        // Gauge width, fixed or derived from the maximum health of each Battler
+        mGaugeWidthSetting = atoi( rConfiguration["GaugeWidth"].c_str() );
+        if( 0 >= mGaugeWidthSetting )
+        {
+
+            mGaugeWidthSetting = GAUGE_WIDTH;
+
+        }
+        mHealthPerPixel = atoi( rConfiguration["HealthPerPixel"].c_str() );
+        // Place monster displays above what the monster graphic actually shows
+        mAnchorToSprite = ( "false" != rConfiguration["AnchorToSprite"] );
+        // Bounds measured in earlier sessions; an empty SpriteCache setting disables the cache file
+        SpriteMetrics::Load( mAnchorToSprite ? ( rConfiguration.count( "SpriteCache" ) ? rConfiguration["SpriteCache"].c_str() : "DynGauge.sprites" ) : "" );
+        if( mAnchorToSprite )
+        {
+
+            SpriteMetrics::SetRtpPath( rConfiguration["RtpPath"].c_str() );
+
+        }
+        // Monsters with a layered health gauge, as a list of database IDs, and settings of single
+        // monsters
+        mBossLayers = rConfiguration["BossLayers"].empty() ? 5 : atoi( rConfiguration["BossLayers"].c_str() );
+        if( mBossLayers < 1 )
+        {
+
+            mBossLayers = 1;
+
+        }
+        ConfigureMonsters( rConfiguration );
+        if( !rConfiguration["GenerateLayout"].empty() )
+        {
+
+            GenerateLayout( rConfiguration["GenerateLayout"] );
+
+        }
+#ifdef DYNGAUGE_FIXED_LAYOUT
+        // The layout was fixed at compile time; the settings above only matter to the generator.
+        // Heroes may show every element, so their layout is the configured one.
+        mShowElement[GAUGE_HEALTH] = HeroLayout::SHOW_HEALTH;
+        mShowElement[GAUGE_MANA] = HeroLayout::SHOW_MANA;
+        mShowElement[GAUGE_ATB] = HeroLayout::SHOW_ATB;
+        mShowElement[ELEMENT_ICONS] = HeroLayout::SHOW_ICONS;
+#endif
+        mLayoutVersion++;
+        mGoldenTest = ( "true" == rConfiguration["GoldenTest"] );
+        CopySetting( mGoldenDirectory, rConfiguration["GoldenDirectory"], "" );
+        mBenchmark = ( "true" == rConfiguration["Benchmark"] );
+        // Blit kernel auto-tuning, with its choices cached in a file
+        mAutoTune = ( "false" != rConfiguration["AutoTune"] );
+        CopySetting( mTuneFile, rConfiguration["TuneFile"], "DynGauge.tune" );
+        // Frames a damage popup is shown; 0 means no popups
+        mPopupFrames = rConfiguration["PopupFrames"].empty() ? 40 : atoi( rConfiguration["PopupFrames"].c_str() );
+        if( 0 > mPopupFrames )
+        {
+
+            mPopupFrames = 0;
+
+        }
+        mPopupHeals = ( "false" != rConfiguration["PopupHeals"] );
+        mPopupEachChange = ( "true" == rConfiguration["PopupEachChange"] );
+        ClearPopups();
+        // Memory accounting; the budget is given in KB
+        mMemoryReport = ( "true" == rConfiguration["MemoryReport"] );
+        mMemoryBudget = atoi( rConfiguration["MemoryBudget"].c_str() ) * 1024;
+
+    }
+
+    //! Copies a setting into a fixed buffer
+    /*!
+        CopySetting() copies a text setting into one of the MAX_PATH_LENGTH buffers which hold
+        them, so nothing of the configuration has to stay allocated after startup. Longer values
+        are cut off.
+
+        \param rDestPtr : (char *) Buffer of MAX_PATH_LENGTH characters
+        \param rValue : (const std::string &) Value from the configuration
+        \param rDefaultPtr : (const char *) Value to use if the setting is empty
+    */
+    static void CopySetting( char * rDestPtr, const std::string & rValue, const char * rDefaultPtr )
+    {
+
+        strncpy( rDestPtr, rValue.empty() ? rDefaultPtr : rValue.c_str(), MAX_PATH_LENGTH - 1 );
+        rDestPtr[MAX_PATH_LENGTH - 1] = '\0';
+
+    }
+
+    //! Reads a list of IDs from a setting
+    /*!
+        ParseIdList() reads numbers separated by commas and/or spaces, such as "12, 37,40", into
+        an array. Reading stops at the first thing which is not a number, or when the array is
+        full.
+
+        \param rListPtr : (const char *) Value from the configuration
+        \param rIdPtr : (int *) Array to fill
+        \param rMaxIds : (int) Size of the array
+        \param rNumIds : (int &) Receives the number of IDs read
+    */
+    static void ParseIdList( const char * rListPtr, int * rIdPtr, int rMaxIds, int & rNumIds )
+    {
+
+        char * endPtr;          // End of the number just read
+
+        rNumIds = 0;
+        while( rNumIds < rMaxIds )
+        {
+
+            rIdPtr[rNumIds] = static_cast<int>( strtol( rListPtr, &endPtr, 10 ) );
+            if( endPtr == rListPtr )
+            {
+
+                break;
+
+            }
+            rNumIds++;
+            for( rListPtr = endPtr; ',' == *rListPtr || ' ' == *rListPtr; rListPtr++ )
+            {
+            }
+
+        }
+
+    }
+
+    //! Writes the current layout as a C++ header
+    /*!
+        GenerateLayout() writes a header defining the classes HeroLayout and MonsterLayout, which
+        describe the layout read from the configuration with compile-time constants: which
+        elements each side shows and where they are. A release build for a game which never
+        changes its layout can include it by defining DYNGAUGE_FIXED_LAYOUT, so all layout
+        decisions are made by the compiler.
+
+        \param rFileName : (const std::string &) File name of the header to write
+    */
+    static void GenerateLayout( const std::string & rFileName )
+    {
+
+        std::ofstream header( rFileName.c_str() );      // Header file
+
+        header << "// Generated by DynGauge from DynRPG.ini; do not edit." << std::endl
+               << "// Build DynGauge with DYNGAUGE_FIXED_LAYOUT defined to use this layout." << std::endl
+               << "#ifndef DYNGAUGE_LAYOUT_H" << std::endl
+               << "#define DYNGAUGE_LAYOUT_H" << std::endl;
+        WriteLayout( header, "HeroLayout", HeroPolicy::ELEMENTS );
+        WriteLayout( header, "MonsterLayout", MonsterPolicy::ELEMENTS );
+        header << std::endl << "#endif // DYNGAUGE_LAYOUT_H" << std::endl;
+        header.close();
+
+    }
+
+    //! Writes the layout of one side as a C++ class
+    /*!
+        \param rHeader : (std::ofstream &) Header being written
+        \param rName : (const char *) Name of the class
+        \param rElements : (int) Mask of the display elements the side's policy allows
+    */
+    static void WriteLayout( std::ofstream & rHeader, const char * rName, int rElements )
+    {
+
+        const static char * NAMES[NUM_ELEMENTS] = { "HEALTH", "MANA", "ATB", "ICONS" };
+
+        int element;            // Index variable
+        int y;                  // Bottom of the next element
+        bool shown;             // Whether the current element is shown
+
+        rHeader << std::endl << "struct " << rName << std::endl
+                << "{" << std::endl << std::endl;
+        y = DISPLAY_HEIGHT;
+        for( element = 0; element < NUM_ELEMENTS; element++ )
+        {
+
+            shown = mShowElement[element] && 0 != ( rElements & ( 1 << element ) );
+            if( shown )
+            {
+
+                y -= ( ELEMENT_ICONS == element ) ? ICON_STRIP_HEIGHT : GAUGE_HEIGHT;
+
+            }
+            rHeader << "    enum { SHOW_" << NAMES[element] << " = " << ( shown ? 1 : 0 )
+                    << ", " << NAMES[element] << "_Y = " << ( shown ? y : 0 ) << " };" << std::endl;
+
+        }
+        rHeader << std::endl << "};" << std::endl;
+
+    }
+
+    //! Runs the golden-image self-test, if it is enabled
+    /*!
+        RunGoldenTest() renders a matrix of battler states through both the reference renderer and
+        the optimized Draw() path and compares the results byte-for-byte. The states are visited in
+        an order which exercises the incremental paths (growing, shrinking, full, empty and
+        unchanged values) rather than only drawing each state from a blank Image. A summary is
+        written to DynGauge_golden.txt, and if GoldenDirectory is set, both Images of every
+        mismatching state are saved there for inspection.
+
+        \return (int) Number of mismatching states, or -1 if the test is disabled
+    */
+    static int RunGoldenTest()
+    {
+
+        // Fractions (in 1/4ths) of the maximum used for health and mana; repeated values test
+        // the unchanged path and the jumps test growing and shrinking bars
+        const static int FRACTIONS[] = { 4, 3, 3, 0, 4, 1, 2, 0, 0, 4 };
+        const static int NUM_FRACTIONS = sizeof( FRACTIONS ) / sizeof( FRACTIONS[0] );
+        // ATB values, including the "full" boundary which switches to bar B
+        const static int ATB_VALUES[] = { 0, ATB_MAX / 3, ATB_MAX - 1, ATB_MAX, 0 };
+        const static int NUM_ATB_VALUES = sizeof( ATB_VALUES ) / sizeof( ATB_VALUES[0] );
+        // Condition masks, including one with more conditions than fit in the icon strip
+        const static unsigned int MASKS[] = { 0, 0x1, 0x80000005, 0xFFFFFFFF, 0x1 };
+        const static int NUM_MASKS = sizeof( MASKS ) / sizeof( MASKS[0] );
+        // Maximum values, including odd and tiny ones to test rounding of the bar width
+        const static int MAXIMUMS[] = { 1, 7, 999, 9999 };
+        const static int NUM_MAXIMUMS = sizeof( MAXIMUMS ) / sizeof( MAXIMUMS[0] );
+        // Gauge widths used with each maximum: the standard width and composed ones
+        const static int WIDTHS[NUM_MAXIMUMS] = { GAUGE_WIDTH, MIN_GAUGE_WIDTH + 7, DISPLAY_WIDTH, GAUGE_WIDTH };
+        // Layers of the health gauge used with each maximum, so the largest one tests boss mode
+        const static int LAYERS[NUM_MAXIMUMS] = { 1, 1, 1, 4 };
+
+        int h, m, a, l, e;          // Index variables
+        int x;                      // Index of the maximum used with the current layout
+        bool savedLayout[NUM_ELEMENTS];     // Layout to restore after the test
+        bool savedNumbers;          // Number setting to restore after the test
+        int mismatches;             // Number of mismatching states
+        int states;                 // Number of states tested
+        int previousHealth;         // Displayed health of the previous state (fixed-point)
+        BattleDisplay display;      // Display under test
+        RPG::Image * referencePtr;  // Image rendered by the reference renderer
+        std::ofstream report;       // Report file
+
+        if( !mGoldenTest )
+        {
+
+            return -1;
+
+        }
+        if( !mInitialized )
+        {
+
+            InitializeStatic();
+
+        }
+        referencePtr = mBattleArena.Acquire( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+        if( NULL == referencePtr || !display.AcquireImages() )
+        {
+
+            mBattleArena.Release( referencePtr );
+            display.ReleaseImages();
+            return -1;
+
+        }
+        report.open( "DynGauge_golden.txt" );
+        mismatches = 0;
+        states = 0;
+        for( e = 0; e < NUM_ELEMENTS; e++ )
+        {
+
+            savedLayout[e] = mShowElement[e];
+
+        }
+        savedNumbers = mShowNumbers;
+        for( l = 0; l <= NUM_ELEMENTS; l++ )
+        {
+
+            // Maximums are used in turn, and numbers are shown for every other layout
+            x = l % NUM_MAXIMUMS;
+            mShowNumbers = ( 1 == l % 2 );
+            display.mMaxHealth = MAXIMUMS[x];
+            display.SetLayers( LAYERS[x] );
+            display.SetGaugeWidth( WIDTHS[x] );
+#ifndef DYNGAUGE_FIXED_LAYOUT
+            // Layouts are all elements, then each one left out in turn, so display lists are
+            // compiled again between states
+            for( e = 0; e < NUM_ELEMENTS; e++ )
+            {
+
+                mShowElement[e] = ( e + 1 != l );
+
+            }
+            mLayoutVersion++;
+#endif
+            for( h = 0; h < NUM_FRACTIONS; h++ )
+            {
+
+                for( m = NUM_FRACTIONS - 1; m >= 0; m-- )
+                {
+
+                    for( a = 0; a < NUM_ATB_VALUES; a++ )
+                    {
+
+                        display.mMaxHealth = MAXIMUMS[x];
+                        display.mCurHealth = MAXIMUMS[x] * FRACTIONS[h] / 4;
+                        display.mMaxMana = MAXIMUMS[x];
+                        display.mCurMana = MAXIMUMS[x] * FRACTIONS[m] / 4;
+                        display.mCurATB = ATB_VALUES[a];
+                        display.mConditionMask = MASKS[states % NUM_MASKS];
+                        display.mBlinkMask = MASKS[( states + 1 ) % NUM_MASKS];
+                        display.mBlinkHidden = ( 0 != states % 3 );
+                        display.mConditionTurns[states % MAX_CONDITIONS] = states % ( MAX_TURNS + 1 );
+                        display.mTurnsChanged = true;
+                        display.mFlashing = ( 0 == states % 5 );
+                        previousHealth = display.mShownHealth;
+                        display.Settle();
+                        if( previousHealth > display.mShownHealth )
+                        {   // Health went down; show the loss as a damage ghost
+
+                            display.mGhostActive = true;
+                            display.mGhostHealth = previousHealth;
+
+                        }
+                        display.Draw<HeroPolicy>();
+                        display.DrawReference( referencePtr );
+                        states++;
+                        if( !display.Matches( referencePtr ) || !display.Settled() )
+                        {   // A display which is not settled after drawing would be drawn every frame
+
+                            mismatches++;
+                            report << ( display.Settled() ? "MISMATCH" : "UNSETTLED" ) << " max=" << MAXIMUMS[x]
+                                   << " hp=" << display.mCurHealth
+                                   << " mp=" << display.mCurMana
+                                   << " atb=" << display.mCurATB
+                                   << " icons=" << display.VisibleConditions() << std::endl;
+                            if( '\0' != mGoldenDirectory[0] )
+                            {
+
+                                std::stringstream name;     // Base file name for this state
+
+                                name << mGoldenDirectory << "/state" << states;
+                                referencePtr->saveToFile( name.str() + "_reference.bmp" );
+                                display.mDisplayPtr->saveToFile( name.str() + "_draw.bmp" );
+
+                            }
+                            // Resynchronize so one bad state does not cascade into the rest
+                            display.Invalidate();
+
+                        }
+
+                    }
+
+                }
+
+            }
+
+        }
+        for( e = 0; e < NUM_ELEMENTS; e++ )
+        {
+
+            mShowElement[e] = savedLayout[e];
+
+        }
+        mShowNumbers = savedNumbers;
+        mLayoutVersion++;
+        // The Images are only needed for the test, not for the rest of the battle
+        mBattleArena.Release( referencePtr );
+        display.ReleaseImages();
+        report << states << " states tested, " << mismatches << " mismatches" << std::endl;
+        report.close();
+        // Only run once per session
+        mGoldenTest = false;
+        return mismatches;
+
+    }
+
+    //! Runs the blit benchmark, if it is enabled
+    /*!
+        RunBenchmark() draws every Sprite of the atlas BENCHMARK_ROUNDS times with each blit
+        strategy and writes the times to DynGauge_benchmark.txt. Row copy ignores transparency and
+        is only listed as the upper bound of what a keyed kernel can reach.
+    */
+    static void RunBenchmark()
+    {
+
+        const static char * NAMES[] = { "RPG::Image::draw", "per-pixel", "RLE", "SSE2", "row copy" };
+
+        int strategy, round, i;         // Index variables
+        int rawBytes, rleBytes;         // Sizes of the sprites as plain pixels and as runs
+        LARGE_INTEGER start, end, frequency;    // Performance counter values
+        RPG::Image * targetPtr;         // Image drawn onto
+        Sprite * spritePtr[MAX_SPRITES];// Every Sprite of the atlas
+        int count;                      // Number of Sprites
+        std::ofstream report;           // Report file
+
+        if( !mBenchmark )
+        {
+
+            return;
+
+        }
+        if( !mInitialized )
+        {
+
+            InitializeStatic();
+
+        }
+        count = CollectSprites( spritePtr, -1 );
+        rawBytes = 0;
+        rleBytes = 0;
+        for( i = 0; i < count; i++ )
+        {
+
+            rawBytes += spritePtr[i]->mWidth * spritePtr[i]->mHeight;
+            rleBytes += spritePtr[i]->mRLE.Size();
+
+        }
+        // Time every strategy; the kernels come first, then row copy
+        targetPtr = mBattleArena.Acquire( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+        if( NULL == targetPtr )
+        {
+
+            return;
+
+        }
+        report.open( "DynGauge_benchmark.txt" );
+        report << count << " sprites, " << rawBytes << " bytes as pixels, " << rleBytes << " bytes as runs" << std::endl;
+        QueryPerformanceFrequency( &frequency );
+        for( strategy = 0; strategy <= Sprite::NUM_KERNELS; strategy++ )
+        {
+
+            if( strategy < Sprite::NUM_KERNELS && !Sprite::KernelAvailable( strategy ) )
+            {
+
+                report << NAMES[strategy] << ": not available in this build" << std::endl;
+                continue;
+
+            }
+            QueryPerformanceCounter( &start );
+            for( round = 0; round < BENCHMARK_ROUNDS; round++ )
+            {
+
+                for( i = 0; i < count; i++ )
+                {
+
+                    if( strategy < Sprite::NUM_KERNELS )
+                    {
+
+                        spritePtr[i]->DrawWith( strategy, targetPtr, 0, 0, 0, spritePtr[i]->mWidth );
+
+                    }
+                    else
+                    {
+
+                        Blitter::CopyRows( targetPtr, 0, 0, spritePtr[i]->mImagePtr, spritePtr[i]->mX, spritePtr[i]->mY, spritePtr[i]->mWidth, spritePtr[i]->mHeight );
+
+                    }
+
+                }
+
+            }
+            QueryPerformanceCounter( &end );
+            report << NAMES[strategy] << ": "
+                   << ( end.QuadPart - start.QuadPart ) * 1000000.0 / frequency.QuadPart / ( BENCHMARK_ROUNDS * count )
+                   << " microseconds per sprite" << std::endl;
+
+        }
+        report.close();
+        mBattleArena.Release( targetPtr );
+        // Only run once per session
+        mBenchmark = false;
+
+    }
+
+    //! Selects the fastest blit kernel for every class of Sprites
+    /*!
+        AutoTune() picks a blit kernel for every Sprite class. If the tuning file exists and was
+        written for the same atlas, its choices are used; otherwise every available kernel is
+        timed drawing the real Sprites of each class, the fastest is selected, and the choices are
+        written to the tuning file so later sessions skip the calibration. The file is keyed by
+        the processor it was calibrated on and by the atlas, which is identified by the number and
+        encoded size of its Sprites; a file shipped from another machine is calibrated again.
+    */
+    static void AutoTune()
+    {
+
+        int sprites, bytes;             // Signature of the atlas
+        int fileSprites, fileBytes;     // Signature of the atlas the tuning file was written for
+        std::string cpu, fileCpu;       // Processor of this session and the one the tuning file was written for
+        int kernel[Sprite::NUM_CLASSES];// Kernels read from the tuning file
+        int spriteClass, k, round, i;   // Index variables
+        int count;                      // Number of Sprites in the class being timed
+        LONGLONG best, time;            // Fastest time of the class so far, time of the current kernel
+        LARGE_INTEGER start, end;       // Performance counter values
+        Sprite * spritePtr[MAX_SPRITES];// Sprites being timed
+        RPG::Image * targetPtr;         // Image drawn onto
+        bool valid;                     // Whether the tuning file is usable
+
+        if( !mAutoTune || mTuned )
+        {
+
+            return;
+
+        }
+        if( !mInitialized )
+        {
+
+            InitializeStatic();
+
+        }
+        mTuned = true;
+        count = CollectSprites( spritePtr, -1 );
+        sprites = count;
+        bytes = 0;
+        for( i = 0; i < count; i++ )
+        {
+
+            bytes += spritePtr[i]->mRLE.Size();
+
+        }
+        // Use the tuning file if it matches this atlas and build
+        std::ifstream tuning( mTuneFile );      // Tuning file
+        cpu = CpuIdentity();
+        valid = ( tuning >> fileCpu >> fileSprites >> fileBytes ) && fileCpu == cpu && fileSprites == sprites && fileBytes == bytes;
+        for( spriteClass = 0; valid && spriteClass < Sprite::NUM_CLASSES; spriteClass++ )
+        {
+
+            valid = ( tuning >> kernel[spriteClass] ) && Sprite::KernelAvailable( kernel[spriteClass] );
+
+        }
+        tuning.close();
+        if( valid )
+        {
+
+            for( spriteClass = 0; spriteClass < Sprite::NUM_CLASSES; spriteClass++ )
+            {
+
+                Sprite::mKernel[spriteClass] = kernel[spriteClass];
+
+            }
+            return;
+
+        }
+        // Calibrate
+        targetPtr = mBattleArena.Acquire( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+        if( NULL == targetPtr )
+        {
+
+            return;
+
+        }
+        for( spriteClass = 0; spriteClass < Sprite::NUM_CLASSES; spriteClass++ )
+        {
+
+            count = CollectSprites( spritePtr, spriteClass );
+            best = 0;
+            for( k = 0; 0 < count && k < Sprite::NUM_KERNELS; k++ )
+            {
+
+                if( !Sprite::KernelAvailable( k ) )
+                {
+
+                    continue;
+
+                }
+                QueryPerformanceCounter( &start );
+                for( round = 0; round < TUNE_ROUNDS; round++ )
+                {
+
+                    for( i = 0; i < count; i++ )
+                    {
+
+                        spritePtr[i]->DrawWith( k, targetPtr, 0, 0, 0, spritePtr[i]->mWidth );
+
+                    }
+
+                }
+                QueryPerformanceCounter( &end );
+                time = end.QuadPart - start.QuadPart;
+                if( 0 == best || time < best )
+                {
+
+                    best = time;
+                    Sprite::mKernel[spriteClass] = k;
+
+                }
+
+            }
+
+        }
+        mBattleArena.Release( targetPtr );
+        // Remember the choices
+        std::ofstream output( mTuneFile );      // Tuning file
+        output << cpu << std::endl;
+        output << sprites << " " << bytes << std::endl;
+        for( spriteClass = 0; spriteClass < Sprite::NUM_CLASSES; spriteClass++ )
+        {
+
+            output << Sprite::mKernel[spriteClass] << std::endl;
+
+        }
+        output.close();
+
+    }
+
+    //! Identifies the processor
+    /*!
+        CpuIdentity() builds a word from the CPUID vendor string and the family, model, and
+        stepping of the processor, e.g. "GenuineIntel-6-158-10". Builds for other processors
+        return "unknown".
+
+        \return (std::string) Identity of the processor, without spaces
+    */
+    static std::string CpuIdentity()
+    {
+
+        std::ostringstream identity;    // Identity being built
+#if defined( __i386__ ) || defined( __x86_64__ )
+        unsigned int eax, ebx, ecx, edx;        // CPUID registers
+        char vendor[13];                // Vendor string
+        unsigned int family, model;     // Family and model, including the extended fields
+        int i;                          // Index variable
+
+        if( !__get_cpuid( 0, &eax, &ebx, &ecx, &edx ) )
+        {
+
+            return "unknown";
+
+        }
+        memcpy( vendor, &ebx, 4 );
+        memcpy( vendor + 4, &edx, 4 );
+        memcpy( vendor + 8, &ecx, 4 );
+        vendor[12] = '\0';
+        for( i = 0; i < 12; i++ )
+        {   // Some vendor strings are padded with spaces
+
+            vendor[i] = ( ' ' == vendor[i] ) ? '_' : vendor[i];
+
+        }
+        __get_cpuid( 1, &eax, &ebx, &ecx, &edx );
+        family = ( eax >> 8 ) & 0xF;
+        model = ( eax >> 4 ) & 0xF;
+        if( 0xF == family )
+        {
+
+            family += ( eax >> 20 ) & 0xFF;
+
+        }
+        if( 0x6 == family || 0xF <= family )
+        {
+
+            model += ( ( eax >> 16 ) & 0xF ) << 4;
+
+        }
+        identity << vendor << "-" << family << "-" << model << "-" << ( eax & 0xF );
+#else
+        identity << "unknown";
+#endif
+        return identity.str();
+
+    }
+
+private:
+
+    //! Command of a display list
+    /*!
+        A DisplayCommand is one step of drawing the display Image, with everything that depends
+        on the layout resolved when the display list is compiled: where to draw, which Sprites,
+        and where the values come from. It also remembers what it last drew.
+    */
+    struct DisplayCommand
+    {
+
+        int mType;                                      //!< Type of command (COMMAND_GAUGE or COMMAND_ICONS)
+        int mGauge;                                     //!< Index of the gauge Sprites (COMMAND_GAUGE only)
+        int mY;                                         //!< Y coordinate in the display Image
+        int mHeight;                                    //!< Height of the area drawn by the command
+        const int * mValuePtr;                          //!< Pointer to the displayed value
+        int mValueShift;                                //!< Number of fractional bits of the displayed value
+        const int * mMaxPtr;                            //!< Pointer to the maximum value
+        const int * mGhostPtr;                          //!< Pointer to the damage ghost value (fixed-point)
+        int mDrawnFill;                                 //!< Width of the bar on the display Image
+        int mDrawnGhostFill;                            //!< Width up to which the damage ghost is on the display Image
+        bool mPercent;                                  //!< Whether the number shows the value in percent of the maximum
+        int mGlyph[NUMBER_CELLS];                       //!< Glyph indices of the number, right-aligned (NO_GLYPH = empty cell)
+        int mDrawnGlyph[NUMBER_CELLS];                  //!< Glyph indices on the display Image
+        int mDrawnNumber;                               //!< Number on the display Image (-1 = none)
+        int mDrawnVariant;                              //!< Color variant of the gauge on the display Image
+        int mDrawnNumberVariant;                        //!< Color variant of the number on the display Image
+        int mDrawnLayer;                                //!< Layer of the bar on the display Image (boss health gauges)
+
+    };
+
+    //! Damage or heal popup
+    /*!
+        A Popup is a number floating up from a Battler. Popups live in a fixed pool and are drawn
+        straight onto the Canvas, so they never touch the display Images.
+    */
+    struct Popup
+    {
+
+        int mX;                                         //!< X coordinate of the center of the number on the Canvas
+        int mY;                                         //!< Y coordinate of the number on the Canvas when it appeared
+        int mNumDigits;                                 //!< Number of digits
+        int mDigit[MAX_POPUP_DIGITS];                   //!< Digits, most significant first
+        int mAge;                                       //!< Number of frames the popup has been shown (mPopupFrames or more = unused)
+        const BattleDisplay * mOwnerPtr;                //!< BattleDisplay that spawned the popup and draws it
+
+    };
+
+    //! Gauge frame and bars of one width
+    /*!
+        GaugeFrames holds a gauge frame with its two bars at one width, composed once from the
+        standard width Images by nine-slicing, so a gauge of any width is drawn like one of the
+        standard width.
+    */
+    struct GaugeFrames
+    {
+
+        int mGauge;                                     //!< Kind of frames: index of the gauge, or of a boss layer tint after them
+        int mWidth;                                     //!< Width of the frame and the bars
+        RPG::Image * mGaugePtr;                         //!< Pointer to the gauge frame Image
+        RPG::Image * mBarAPtr;                          //!< Pointer to the bar A ("non-full") Image
+        RPG::Image * mBarBPtr;                          //!< Pointer to the bar B ("full") Image
+        Sprite mGaugeSprite;                            //!< Gauge frame Sprite
+        Sprite mBarASprite;                             //!< Bar A Sprite
+        Sprite mBarBSprite;                             //!< Bar B Sprite
+        int mUsedIn;                                    //!< Generation of the battle arena in which the frames were last acquired
+
+    };
+
+    //! Settings of a monster
+    /*!
+        MonsterSettings holds what can be set per monster database ID. Monsters without settings
+        of their own use entry 0 of mMonsterSettings, the defaults.
+    */
+    struct MonsterSettings
+    {
+
+        int mOffsetX;                                   //!< Offset of the display on the Canvas, to the right
+        int mOffsetY;                                   //!< Offset of the display on the Canvas, downwards
+        int mGaugeWidth;                                //!< Width of the gauges (0 = as for every Battler)
+        int mLayers;                                    //!< Number of layers of the health gauge (1 = not layered)
+        int mElements;                                  //!< Mask of the display elements shown, on top of the configured layout
+
+    };
+
+    static bool mInitialized;                           //!< Flag indicating whether the static members of the class have been initialized
+    static int mFrameCount;                             //!< Number of frames since startup
+    static int mAnimationRate;                          //!< Fraction of the remaining distance covered by animated values per frame, in 1/256ths
+    static int mGhostDelay;                             //!< Frames before the damage ghost starts to decay (0 = no damage ghost)
+    static TimerWheel mTimerWheel;                      //!< Timer wheel driving the time-based effects of all BattleDisplays
+    static char mIconSetFile[MAX_PATH_LENGTH];          //!< File name of the iconset atlas
+    static int mBlinkInterval;                          //!< Frames between two blinks of a new condition's icon (0 = no blinking)
+    static bool mShowCounters;                          //!< Whether turn counters are drawn on status condition icons
+    static bool mShowElement[NUM_ELEMENTS];             //!< Whether each display element is shown
+    static bool mShowNumbers;                           //!< Whether gauges show their value as a number (ATB in percent)
+    static unsigned char mInnerPairGlyph[100];          //!< Glyph index of each pair 00-99 when it is not the first pair of a number
+    static unsigned char mRemap[NUM_VARIANTS][256];     //!< Remap table of each color variant, for the palette of the SystemGraphic
+    static unsigned char mLayerRemap[NUM_LAYER_TINTS][256];         //!< Remap table of each boss layer tint
+    static unsigned char mReferenceColor[NUM_LAYER_TINTS][NUM_VARIANTS][256];   //!< Color the reference renderer draws for each color, layer tint and variant
+    static bool mReferenceReady;                        //!< Whether mReferenceColor was built
+    static unsigned char mMonsterSlot[MAX_MONSTER_ID + 1];          //!< Index into mMonsterSettings for each monster database ID (0 = defaults)
+    static MonsterSettings mMonsterSettings[MAX_MONSTER_SETTINGS];  //!< Distinct monster settings; entry 0 holds the defaults
+    static int mNumMonsterSettings;                     //!< Number of entries in mMonsterSettings
+    static int mBossLayers;                             //!< Number of layers of a boss health gauge
+    static int mLowHealthPercent;                       //!< Health in percent at or below which the health number turns red (0 = never)
+    static bool mFlashOnHit;                            //!< Whether the health gauge flashes when the Battler is hit
+    static int mPanelOpacity;                           //!< Opacity of the background panel behind the elements (0 = no panel)
+    static int mPanelColor;                             //!< Color of the background panel, 0xRRGGBB
+    static int mGaugeWidthSetting;                      //!< Width of the gauges, unless derived from maximum health
+    static int mHealthPerPixel;                         //!< Maximum health per pixel of gauge width (0 = all gauges are mGaugeWidthSetting wide)
+    static bool mAnchorToSprite;                        //!< Whether monster displays are placed above the opaque part of the monster's graphic
+    static bool mAnchorsChecked;                        //!< Whether CheckAnchors() has checked a battle with monsters in this session
+    static GaugeFrames mFrames[MAX_FRAMES];             //!< Cache of gauge frames and bars, the standard width ones first
+    static int mNumFrames;                              //!< Number of entries in mFrames
+    static int mLayoutVersion;                          //!< Increased whenever the layout changes, so display lists are compiled again
+    static int mShadowInterval;                         //!< Frames between shadow checks (0 = shadow mode off)
+    static int mNextShadowPhase;                        //!< Phase handed to the next BattleDisplay, so shadow checks are spread over frames
+    static bool mGoldenTest;                            //!< Whether the golden-image self-test should run
+    static char mGoldenDirectory[MAX_PATH_LENGTH];      //!< Directory in which mismatching golden-image states are saved (empty = don't save)
+    static bool mBenchmark;                             //!< Whether the blit benchmark should run
+    static bool mAutoTune;                              //!< Whether blit kernels are auto-tuned
+    static bool mTuned;                                 //!< Whether the blit kernels have been tuned in this session
+    static char mTuneFile[MAX_PATH_LENGTH];             //!< File name of the tuning file
+    static bool mMemoryReport;                          //!< Whether a memory report is written at the end of each battle and on exit
+    static int mMemoryBudget;                           //!< Maximum number of bytes DynGauge should hold (0 = no budget)
+    static int mEvictedBytes;                           //!< Number of bytes evicted from the caches so far
+    static bool mIconSetEvicted;                        //!< Whether the iconset was evicted and has to be loaded again before drawing
+    static int mPopupFrames;                            //!< Number of frames a popup is shown (0 = no popups)
+    static bool mPopupHeals;                            //!< Whether healing gets popups too
+    static bool mPopupEachChange;                       //!< Whether every HP change within a frame gets its own popup, instead of one for the net change
+    static Popup mPopup[MAX_POPUPS];                    //!< Popup pool
+    static int mNextPopup;                              //!< Index of the popup to use next
+
+    int mCurHealth;                                     //!< Current health
+    int mMaxHealth;                                     //!< Maximum health
+    int mCurMana;                                       //!< Current mana
+    int mMaxMana;                                       //!< Maximum mana
+    int mCurATB;                                        //!< Current ATB fill value
+    int mShownHealth;                                   //!< Displayed health (fixed-point), approaching mCurHealth
+    int mShownMana;                                     //!< Displayed mana (fixed-point), approaching mCurMana
+    int mGhostHealth;                                   //!< Health shown by the damage ghost (fixed-point)
+    bool mGhostActive;                                  //!< Whether the damage ghost is shown
+    bool mGhostDecaying;                                //!< Whether the damage ghost's delay has expired
+    Timer mGhostTimer;                                  //!< Timer for the delay of the damage ghost
+    Timer mFlashTimer;                                  //!< Timer for the end of the hit flash
+    bool mFlashing;                                     //!< Whether the health gauge currently flashes
+    int mDrawnVariants;                                 //!< Color variants on the display Image, as returned by Variants()
+    int mPanelTop;                                      //!< Y coordinate of the top of the topmost shown element, where the panel starts
+    int mGaugeWidth;                                    //!< Width of the gauges of this BattleDisplay
+    int mOffsetX;                                       //!< Offset of the display on the Canvas, to the right
+    int mOffsetY;                                       //!< Offset of the display on the Canvas, downwards
+    bool mAnchored;                                     //!< Whether the display was placed above the opaque part of the monster's graphic
+    GaugeFrames * mFramesPtr[NUM_GAUGES];               //!< Frames and bars of the gauges, at mGaugeWidth
+    GaugeFrames * mLayerFramesPtr[NUM_LAYER_TINTS];     //!< Health bars of each layer tint, at mGaugeWidth
+    int mLayerHealth;                                   //!< Health per layer of the health gauge (0 = not layered)
+    int mTopLayer;                                      //!< Index of the topmost layer, which may hold less than mLayerHealth
+    int mSplitHealth;                                   //!< Displayed health the layer was last computed for (-1 = none)
+    int mLayer;                                         //!< Layer the displayed health is in (0 = bottom)
+    int mLayersLeft;                                    //!< Number of layers with health left, shown as the layer counter
+    int mLayerValue;                                    //!< Displayed health within the current layer
+    int mLayerMax;                                      //!< Capacity of the current layer
+    int mLayerGhost;                                    //!< Damage ghost within the current layer (fixed-point)
+    Timer mFadeTimer;                                   //!< Timer for the next step of a fade
+    int mAlpha;                                         //!< Current opacity of the display (0 = invisible)
+    int mTargetAlpha;                                   //!< Opacity the display is fading towards
+    unsigned int mConditionMask;                        //!< Status conditions of the Battler, bit N-1 for condition N
+    unsigned int mBlinkMask;                            //!< Status conditions whose icons are blinking
+    bool mBlinkHidden;                                  //!< Whether blinking icons are currently hidden
+    int mBlinkCount;                                    //!< Number of blink toggles left
+    Timer mBlinkTimer;                                  //!< Timer for the next blink toggle
+    RPG::Image * mIconStripPtr;                         //!< Pointer to the cached icon strip Image
+    unsigned int mStripMask;                            //!< Status conditions the icon strip was composed for
+    unsigned int mDrawnIconMask;                        //!< Status conditions whose icons are on the display Image
+    unsigned char mConditionTurns[MAX_CONDITIONS];      //!< Turn counters of the status conditions, index N-1 for condition N
+    bool mTurnsChanged;                                 //!< Whether a turn counter changed since the icon strip was composed
+    bool mIconsInvalid;                                 //!< Whether the icon strip on the display Image must be redrawn
+    bool mInvalid;                                      //!< Whether the whole display Image must be redrawn
+    int mMaxATB;                                        //!< Maximum ATB value (ATB_MAX), as a member so the display list can point to it
+    int mNoGhost;                                       //!< Always 0; the damage ghost of gauges which have none
+    DisplayCommand mCommand[NUM_ELEMENTS];              //!< Display list
+    int mNumCommands;                                   //!< Number of commands in the display list
+    int mElements;                                      //!< Mask of the display elements the policy of this BattleDisplay allows
+    int mObservedHealth;                                //!< HP of the Battler when it was last observed
+    int mChange[MAX_CHANGES];                           //!< HP changes observed since the last Update()
+    int mNumChanges;                                    //!< Number of entries in mChange
+    int mCompiledVersion;                               //!< Layout version the display list was compiled for
+    int mShadowPhase;                                   //!< Offset of this BattleDisplay's shadow checks within the interval
+
+    RPG::Image * mDisplayPtr;                           //!< Pointer to display Image
+    RPG::Battler * mBattlerPtr;                         //!< Pointer to Battler for which this BattleDisplay is used
+
+    //! Reads the per-monster settings
+    /*!
+        ConfigureMonsters() reads the settings of single monsters into a table indexed by
+        database ID, so looking them up in SetBattler() is a single array access. Monsters listed
+        in BossMonsters get BossLayers layers. Settings of one monster are given as
+        Monster<ID><Setting>, for example Monster12OffsetY=-16, with these settings:
+        OffsetX, OffsetY (pixels), GaugeWidth (pixels), Layers (count) and Elements (the names
+        HEALTH, MANA, ATB and ICONS of the elements to show, such as "HEALTH ICONS"; elements
+        left out of the configured layout stay hidden; builds with a fixed layout ignore it).
+        Monsters with equal settings do not share a table entry; once the table is full, further
+        monsters keep the defaults.
+
+        \param rConfiguration : (std::map<std::string, std::string> &) Configuration data
+    */
+    static void ConfigureMonsters( std::map<std::string, std::string> & rConfiguration )
+    {
+
+        const static char * NAMES[NUM_ELEMENTS] = { "HEALTH", "MANA", "ATB", "ICONS" };
+
+        int i;                  // Index variable
+        int ids[MAX_BOSSES];    // Database IDs read from BossMonsters
+        int numIds;             // Number of entries in ids
+        int id;                 // Database ID of the current setting
+        const char * keyPtr;    // Current key, behind "Monster"
+        char * suffixPtr;       // Name of the setting, behind the ID
+        const char * valuePtr;  // Value of the current setting
+        MonsterSettings * settingsPtr;  // Settings of the current monster
+        std::map<std::string, std::string>::const_iterator setting;    // Current setting
+
+        memset( mMonsterSlot, 0, sizeof( mMonsterSlot ) );
+        mNumMonsterSettings = 1;
+        ParseIdList( rConfiguration["BossMonsters"].c_str(), ids, MAX_BOSSES, numIds );
+        for( i = 0; i < numIds; i++ )
+        {
+
+            settingsPtr = MonsterSlot( ids[i] );
+            if( NULL != settingsPtr )
+            {
+
+                settingsPtr->mLayers = mBossLayers;
+
+            }
+
+        }
+        for( setting = rConfiguration.begin(); setting != rConfiguration.end(); ++setting )
+        {
+
+            if( 0 != setting->first.compare( 0, 7, "Monster" ) )
+            {
+
+                continue;
+
+            }
+            keyPtr = setting->first.c_str() + 7;
+            id = static_cast<int>( strtol( keyPtr, &suffixPtr, 10 ) );
+            settingsPtr = ( suffixPtr != keyPtr ) ? MonsterSlot( id ) : NULL;
+            if( NULL == settingsPtr )
+            {
+
+                continue;
+
+            }
+            valuePtr = setting->second.c_str();
+            if( 0 == strcmp( suffixPtr, "OffsetX" ) )
+            {
+
+                settingsPtr->mOffsetX = atoi( valuePtr );
+
+            }
+            else if( 0 == strcmp( suffixPtr, "OffsetY" ) )
+            {
+
+                settingsPtr->mOffsetY = atoi( valuePtr );
+
+            }
+            else if( 0 == strcmp( suffixPtr, "GaugeWidth" ) )
+            {
+
+                settingsPtr->mGaugeWidth = atoi( valuePtr );
+
+            }
+            else if( 0 == strcmp( suffixPtr, "Layers" ) )
+            {
+
+                settingsPtr->mLayers = atoi( valuePtr );
+
+            }
+            else if( 0 == strcmp( suffixPtr, "Elements" ) )
+            {
+
+                settingsPtr->mElements = 0;
+                for( i = 0; i < NUM_ELEMENTS; i++ )
+                {
+
+                    if( NULL != strstr( valuePtr, NAMES[i] ) )
+                    {
+
+                        settingsPtr->mElements |= 1 << i;
+
+                    }
+
+                }
+
+            }
+
+        }
+
+    }
+
+    //! Gets the settings of a monster for writing
+    /*!
+        MonsterSlot() returns the table entry of a monster, giving it one with the defaults if it
+        has none yet.
+
+        \param rDatabaseId : (int) Database ID of the monster
+        \return (MonsterSettings *) Pointer to the settings, or NULL if the ID is out of range or
+                 the table is full
+    */
+    static MonsterSettings * MonsterSlot( int rDatabaseId )
+    {
+
+        if( 0 > rDatabaseId || MAX_MONSTER_ID < rDatabaseId )
+        {
+
+            return NULL;
+
+        }
+        if( 0 == mMonsterSlot[rDatabaseId] )
+        {
+
+            if( MAX_MONSTER_SETTINGS == mNumMonsterSettings )
+            {
+
+                return NULL;
+
+            }
+            mMonsterSettings[mNumMonsterSettings] = mMonsterSettings[0];
+            mMonsterSlot[rDatabaseId] = static_cast<unsigned char>( mNumMonsterSettings++ );
+
+        }
+        return &mMonsterSettings[mMonsterSlot[rDatabaseId]];
+
+    }
+
+    //! Gets the settings of a monster
+    /*!
+        \param rDatabaseId : (int) Database ID of the monster
+        \return (const MonsterSettings &) Settings of the monster, or the defaults
+    */
+    static const MonsterSettings & SettingsFor( int rDatabaseId )
+    {
+
+        return mMonsterSettings[( 0 <= rDatabaseId && MAX_MONSTER_ID >= rDatabaseId ) ? mMonsterSlot[rDatabaseId] : 0];
+
+    }
+
+    //! Loads the iconset atlas
+    /*!
+        LoadIconSet() loads the iconset from the IconSet file; without it, no status condition
+        icons are shown.
+    */
+    static void LoadIconSet()
+    {
+
+        mIconSetPtr = RPG::Image::create();
+        mIconSetPtr->loadFromFile( mIconSetFile, false );
+        if( mIconSetPtr->width < ICON_SIZE || mIconSetPtr->height < ICON_SIZE )
+        {
+
+            RPG::Image::destroy( mIconSetPtr );
+            mIconSetPtr = NULL;
+
+        }
+
+    }
+
+    //! Builds the two-digit glyphs
+    /*!
+        BuildCounters() builds the two-digit glyphs from half-size copies of the digits: 0-99
+        without leading zero, as used by the turn counters, then 00-09.
+    */
+    static void BuildCounters()
+    {
+
+        int i;                  // Index variable
+
+        for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+        {
+
+            mCounterPtr[i] = RPG::Image::create( COUNTER_SIZE, COUNTER_SIZE );
+            if( 10 <= i && i < ZERO_PAIR_GLYPH )
+            {
+
+                DrawHalfDigit( mCounterPtr[i], 0, i / 10 );
+
+            }
+            else if( ZERO_PAIR_GLYPH <= i )
+            {
+
+                DrawHalfDigit( mCounterPtr[i], 0, 0 );
+
+            }
+            DrawHalfDigit( mCounterPtr[i], COUNTER_SIZE / 2, ( ZERO_PAIR_GLYPH <= i ) ? i - ZERO_PAIR_GLYPH : i % 10 );
+
+        }
+
+    }
+
+    //! Initializes static member variables
+    /*!
+        This method initializes the static member variables of the class. It should be called
+        before any instances of the class are created.
+    */
+    static void InitializeStatic()
+    {
+
+        int i;          // Index variable
+
+        // Initialize images
+        mHealthGaugePtr->draw( 0, 0,                                            // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               HEALTH_GAUGE_SRC_X, HEALTH_GAUGE_SRC_Y,          // Coordinates in source Image
+                               GAUGE_WIDTH, GAUGE_HEIGHT,                       // Dimensions in source Image
+                               0);                                              // Transparency color
+        mManaGaugePtr->draw( 0, 0,                                              // Coordinates in destination Image
+                             RPG::system->systemGraphic->system2Image,          // Source Image pointer
+                             MANA_GAUGE_SRC_X, MANA_GAUGE_SRC_Y,                // Coordinates in source Image
+                             GAUGE_WIDTH, GAUGE_HEIGHT,                         // Dimensions in source Image
+                             0);                                                // Transparency color
+        mATBGaugePtr->draw( 0, 0,                                               // Coordinates in destination Image
+                            RPG::system->systemGraphic->system2Image,           // Source Image pointer
+                            ATB_GAUGE_SRC_X, ATB_GAUGE_SRC_Y,                   // Coordinates in source Image
+                            GAUGE_WIDTH, GAUGE_HEIGHT,                          // Dimensions in source Image
+                            0);                                                 // Transparency color
+        mHealthBarAPtr->draw( 0, 0,                                             // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               HEALTH_BAR_A_SRC_X, HEALTH_BAR_A_SRC_Y,          // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        mManaBarAPtr->draw( 0, 0,                                               // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               MANA_BAR_A_SRC_X, MANA_BAR_A_SRC_Y,              // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        mATBBarAPtr->draw( 0, 0,                                                // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               ATB_BAR_A_SRC_X, ATB_BAR_A_SRC_Y,                // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        mHealthBarBPtr->draw( 0, 0,                                             // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               HEALTH_BAR_B_SRC_X, HEALTH_BAR_B_SRC_Y,          // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        mManaBarBPtr->draw( 0, 0,                                               // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               MANA_BAR_B_SRC_X, MANA_BAR_B_SRC_Y,              // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        mATBBarBPtr->draw( 0, 0,                                                // Coordinates in destination Image
+                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
+                               ATB_BAR_B_SRC_X, ATB_BAR_B_SRC_Y,                // Coordinates in source Image
+                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
+                               0);                                              // Transparency color
+        for( i = 0; i < NUM_DIGITS; i++ )
+        {
+
+            mDigitPtr[i]->draw( 0, 0,                                           // Coordinates in destination Image
+                                   RPG::system->systemGraphic->system2Image,    // Source Image pointer
+                                   DIGIT_SRC_X + DIGIT_WIDTH * i, DIGIT_SRC_Y,  // Coordinates in source Image
+                                   DIGIT_WIDTH, DIGIT_HEIGHT,                   // Dimensions in source Image
+                                   0);                                          // Transparency color
+            // Popups draw the digits straight onto the Canvas
+            mDigitPtr[i]->useMaskColor = true;
+
+        }
+        LoadIconSet();
+        BuildCounters();
+        // Glyphs of the pairs behind the first one of a number, which keep their leading zero
+        for( i = 0; i < 100; i++ )
+        {
+
+            mInnerPairGlyph[i] = static_cast<unsigned char>( ( 10 > i ) ? ZERO_PAIR_GLYPH + i : i );
+
+        }
+        // The gauges and digits are copies from the System2 graphic, so they share its palette
+        BuildRemapTables( RPG::system->systemGraphic->system2Image->palette );
+        // The panel is a single color, so it gets a palette of its own
+        if( 0 < mPanelOpacity )
+        {
+
+            mPanelPtr = RPG::Image::create( DISPLAY_WIDTH, PANEL_HEIGHT );
+            mPanelPtr->palette[1] = mPanelColor;
+            memset( mPanelPtr->pixels, 1, DISPLAY_WIDTH * PANEL_HEIGHT );
+            mPanelPtr->useMaskColor = false;
+
+        }
+        // Encode all sprites for the fast drawing path
+        mGaugeSprite[GAUGE_HEALTH].Build( mHealthGaugePtr, 0, 0, GAUGE_WIDTH, GAUGE_HEIGHT, Sprite::CLASS_GAUGE );
+        mGaugeSprite[GAUGE_MANA].Build( mManaGaugePtr, 0, 0, GAUGE_WIDTH, GAUGE_HEIGHT, Sprite::CLASS_GAUGE );
+        mGaugeSprite[GAUGE_ATB].Build( mATBGaugePtr, 0, 0, GAUGE_WIDTH, GAUGE_HEIGHT, Sprite::CLASS_GAUGE );
+        mBarASprite[GAUGE_HEALTH].Build( mHealthBarAPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        mBarASprite[GAUGE_MANA].Build( mManaBarAPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        mBarASprite[GAUGE_ATB].Build( mATBBarAPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        mBarBSprite[GAUGE_HEALTH].Build( mHealthBarBPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        mBarBSprite[GAUGE_MANA].Build( mManaBarBPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        mBarBSprite[GAUGE_ATB].Build( mATBBarBPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, Sprite::CLASS_BAR );
+        // The standard width gauges open the frame cache, and are what other widths are made of
+        for( i = 0; i < NUM_GAUGES; i++ )
+        {
+
+            mFrames[i].mGauge = i;
+            mFrames[i].mWidth = GAUGE_WIDTH;
+            mFrames[i].mGaugeSprite = mGaugeSprite[i];
+            mFrames[i].mBarASprite = mBarASprite[i];
+            mFrames[i].mBarBSprite = mBarBSprite[i];
+
+        }
+        mFrames[GAUGE_HEALTH].mGaugePtr = mHealthGaugePtr;
+        mFrames[GAUGE_HEALTH].mBarAPtr = mHealthBarAPtr;
+        mFrames[GAUGE_HEALTH].mBarBPtr = mHealthBarBPtr;
+        mFrames[GAUGE_MANA].mGaugePtr = mManaGaugePtr;
+        mFrames[GAUGE_MANA].mBarAPtr = mManaBarAPtr;
+        mFrames[GAUGE_MANA].mBarBPtr = mManaBarBPtr;
+        mFrames[GAUGE_ATB].mGaugePtr = mATBGaugePtr;
+        mFrames[GAUGE_ATB].mBarAPtr = mATBBarAPtr;
+        mFrames[GAUGE_ATB].mBarBPtr = mATBBarBPtr;
+        mNumFrames = NUM_GAUGES;
+        for( i = 0; i < NUM_DIGITS; i++ )
+        {
+
+            mDigitSprite[i].Build( mDigitPtr[i], 0, 0, DIGIT_WIDTH, DIGIT_HEIGHT, Sprite::CLASS_DIGIT );
+
+        }
+        for( i = 0; NULL != mIconSetPtr && i < MAX_CONDITIONS; i++ )
+        {
+
+            if( ( i / ( mIconSetPtr->width / ICON_SIZE ) + 1 ) * ICON_SIZE <= mIconSetPtr->height )
+            {
+
+                mIconSprite[i].Build( mIconSetPtr,
+                                      ( i % ( mIconSetPtr->width / ICON_SIZE ) ) * ICON_SIZE,
+                                      ( i / ( mIconSetPtr->width / ICON_SIZE ) ) * ICON_SIZE,
+                                      ICON_SIZE, ICON_SIZE, Sprite::CLASS_ICON );
+
+            }
+
+        }
+        for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+        {
+
+            mCounterSprite[i].Build( mCounterPtr[i], 0, 0, COUNTER_SIZE, COUNTER_SIZE, Sprite::CLASS_COUNTER );
+
+        }
+        // Turn on initialized flag
+        mInitialized = true;
+
+    }
+
+    //! Calculates the width of a bar
+    /*!
+        BarFill() calculates how many pixels of a bar are filled for a given value.
+
+        \param rCur : (int) Current value
+        \param rMax : (int) Maximum value
+        \param rWidth : (int) Width of the whole bar
+        \return (int) Width of the filled part of the bar, 0 to rWidth
+    */
+    static int BarFill( int rCur, int rMax, int rWidth )
+    {
+
+        if( rMax <= 0 || rCur <= 0 )
+        {
+
+            return 0;
+
+        }
+        if( rCur >= rMax )
+        {
+
+            return rWidth;
+
+        }
+        return rWidth * rCur / rMax;
+
+    }
+
+    //! Moves a displayed value towards its target
+    /*!
+        Approach() advances a fixed-point displayed value by the animation rate's fraction of the
+        remaining distance, but at least MIN_STEP, snapping to the target once the step would
+        overshoot. Only integer math is used; the distance is scaled down before multiplying so
+        large monster health values cannot overflow.
+
+        \param rShown : (int &) Displayed value (fixed-point) to advance
+        \param rTarget : (int) Target value (integer)
+        \return (bool) true if the displayed value changed
+    */
+    static bool Approach( int & rShown, int rTarget )
+    {
+
+        int target;             // Target value (fixed-point)
+        int distance;           // Remaining distance to the target (absolute)
+        int step;               // Distance to cover this frame
+
+        target = rTarget << FIXED_SHIFT;
+        if( rShown == target )
+        {
+
+            return false;
+
+        }
+        distance = ( target > rShown ) ? target - rShown : rShown - target;
+        step = ( distance >> RATE_SHIFT ) * mAnimationRate;
+        if( step < MIN_STEP )
+        {
+
+            step = MIN_STEP;
+
+        }
+        if( step >= distance )
+        {
+
+            rShown = target;
+
+        }
+        else
+        {
+
+            rShown += ( target > rShown ) ? step : -step;
+
+        }
+        return true;
+
+    }
+
+    //! Ends all animations
+    /*!
+        Settle() sets the displayed values to their targets immediately.
+    */
+    void Settle()
+    {
+
+        mShownHealth = mCurHealth << FIXED_SHIFT;
+        mShownMana = mCurMana << FIXED_SHIFT;
+        CancelGhost();
+
+    }
+
+    //! Starts the decay of the damage ghost
+    /*!
+        OnGhostTimer() is called by the timer wheel when the delay of a damage ghost expires.
+
+        \param rContextPtr : (void *) Pointer to the BattleDisplay
+    */
+    static void OnGhostTimer( void * rContextPtr )
+    {
+
+        static_cast<BattleDisplay *>( rContextPtr )->mGhostDecaying = true;
+
+    }
+
+    //! Starts a fade
+    /*!
+        FadeTo() makes the display fade towards the given opacity, a step every FADE_INTERVAL
+        frames. Nothing happens if the display is already at or fading towards that opacity.
+
+        \param rAlpha : (int) Target opacity
+    */
+    void FadeTo( int rAlpha )
+    {
+
+        if( rAlpha == mTargetAlpha && ( rAlpha == mAlpha || mFadeTimer.IsScheduled() ) )
+        {
+
+            return;
+
+        }
+        mTargetAlpha = rAlpha;
+        mTimerWheel.Schedule( mFadeTimer, FADE_INTERVAL );
+
+    }
+
+    //! Advances a fade
+    /*!
+        OnFadeTimer() is called by the timer wheel for every step of a fade, and schedules the next
+        step until the target opacity is reached.
+
+        \param rContextPtr : (void *) Pointer to the BattleDisplay
+    */
+    static void OnFadeTimer( void * rContextPtr )
+    {
+
+        BattleDisplay * displayPtr;     // BattleDisplay which is fading
+
+        displayPtr = static_cast<BattleDisplay *>( rContextPtr );
+        if( displayPtr->mAlpha < displayPtr->mTargetAlpha )
+        {
+
+            displayPtr->mAlpha = ( displayPtr->mAlpha + FADE_STEP < displayPtr->mTargetAlpha ) ? displayPtr->mAlpha + FADE_STEP : displayPtr->mTargetAlpha;
+
+        }
+        else
+        {
+
+            displayPtr->mAlpha = ( displayPtr->mAlpha - FADE_STEP > displayPtr->mTargetAlpha ) ? displayPtr->mAlpha - FADE_STEP : displayPtr->mTargetAlpha;
+
+        }
+        if( displayPtr->mAlpha != displayPtr->mTargetAlpha )
+        {
+
+            mTimerWheel.Schedule( displayPtr->mFadeTimer, FADE_INTERVAL );
+
+        }
+
+    }
+
+    //! Removes the damage ghost
+    /*!
+        CancelGhost() hides the damage ghost and removes it from the timer wheel.
+    */
+    void CancelGhost()
+    {
+
+        mTimerWheel.Cancel( mGhostTimer );
+        mGhostActive = false;
+        mGhostDecaying = false;
+        mGhostHealth = 0;
+
+    }
+
+    //! Lists the Sprites of the atlas
+    /*!
+        CollectSprites() fills an array with pointers to all Sprites of the atlas which have been
+        built, or only to those of one class.
+
+        \param rSpritePtr : (Sprite **) Array of at least MAX_SPRITES pointers to fill
+        \param rClass : (int) Class of the Sprites to list (-1 = all)
+        \return (int) Number of Sprites listed
+    */
+    static int CollectSprites( Sprite ** rSpritePtr, int rClass )
+    {
+
+        int i;                  // Index variable
+        int count;              // Number of Sprites listed
+        Sprite * all[MAX_SPRITES];      // Every Sprite of the atlas, built or not
+
+        // The Sprites are drawn from, so their Images must be there
+        RestoreCaches();
+        count = 0;
+        for( i = 0; i < NUM_GAUGES; i++ )
+        {
+
+            all[count++] = &mGaugeSprite[i];
+            all[count++] = &mBarASprite[i];
+            all[count++] = &mBarBSprite[i];
+
+        }
+        for( i = 0; i < NUM_DIGITS; i++ )
+        {
+
+            all[count++] = &mDigitSprite[i];
+
+        }
+        for( i = 0; i < MAX_CONDITIONS; i++ )
+        {
+
+            all[count++] = &mIconSprite[i];
+
+        }
+        for( i = 0; i < NUM_PAIR_GLYPHS; i++ )
+        {
+
+            all[count++] = &mCounterSprite[i];
+
+        }
+        count = 0;
+        for( i = 0; i < MAX_SPRITES; i++ )
+        {
+
+            if( all[i]->IsBuilt() && ( -1 == rClass || rClass == all[i]->mClass ) )
+            {
+
+                rSpritePtr[count++] = all[i];
+
+            }
+
+        }
+        return count;
+
+    }
+
+    //! Draws a digit at half size
+    /*!
+        DrawHalfDigit() copies every other pixel of every other row of a digit Image onto an
+        Image, which gives a digit small enough to fit beside another one on a status icon.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the destination Image
+        \param rX : (int) X coordinate of the digit in the destination Image
+        \param rDigit : (int) Digit to draw, 0-9
+    */
+    static void DrawHalfDigit( RPG::Image * rImagePtr, int rX, int rDigit )
+    {
+
+        int x, y;               // Coordinates in the destination Image
+
+        for( y = 0; y < DIGIT_HEIGHT / 2; y++ )
+        {
+
+            for( x = 0; x < DIGIT_WIDTH / 2; x++ )
+            {
+
+                rImagePtr->pixels[y * rImagePtr->width + rX + x] =
+                    mDigitPtr[rDigit]->pixels[2 * y * mDigitPtr[rDigit]->width + 2 * x];
+
+            }
+
+        }
+
+    }
+
+    //! Resets turn counters
+    /*!
+        ResetTurns() sets the turn counters of the given status conditions to 0, visiting only the
+        set bits of the mask.
+
+        \param rMask : (unsigned int) Condition mask of the counters to reset
+    */
+    void ResetTurns( unsigned int rMask )
+    {
+
+        for( ; 0 != rMask; rMask &= rMask - 1 )
+        {
+
+            mConditionTurns[__builtin_ctz( rMask )] = 0;
+
+        }
+        mTurnsChanged = true;
+
+    }
+
+    //! Builds the condition mask of a Battler
+    /*!
+        ConditionMask() collects the status conditions a Battler currently has into a single
+        integer, so that any change can be detected with one comparison. Building it reads one
+        entry per condition in the database, up to MAX_CONDITIONS.
+
+        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler
+        \return (unsigned int) Condition mask, bit N-1 set if the Battler has condition N
+    */
+    static unsigned int ConditionMask( RPG::Battler * rBattlerPtr )
+    {
+
+        int i;                  // Index variable
+        int count;              // Number of conditions to check
+        unsigned int mask;      // Condition mask being built
+
+        mask = 0;
+        count = rBattlerPtr->conditions.size();
+        if( count > MAX_CONDITIONS )
+        {
+
+            count = MAX_CONDITIONS;
+
+        }
+        for( i = 1; i <= count; i++ )
+        {
+
+            if( 0 < rBattlerPtr->conditions[i] )
+            {
+
+                mask |= 1u << ( i - 1 );
+
+            }
+
+        }
+        return mask;
+
+    }
+
+    //! Gets the conditions whose icons are currently visible
+    /*!
+        \return (unsigned int) Condition mask without the icons hidden by blinking
+    */
+    unsigned int VisibleConditions()
+    {
+
+        return mBlinkHidden ? ( mConditionMask & ~mBlinkMask ) : mConditionMask;
+
+    }
+
+    //! Toggles blinking icons
+    /*!
+        OnBlinkTimer() is called by the timer wheel to hide or show the icons of newly inflicted
+        conditions, and schedules the next toggle until BLINK_TOGGLES toggles are done.
+
+        \param rContextPtr : (void *) Pointer to the BattleDisplay
+    */
+    static void OnBlinkTimer( void * rContextPtr )
+    {
+
+        BattleDisplay * displayPtr;     // BattleDisplay whose icons blink
+
+        displayPtr = static_cast<BattleDisplay *>( rContextPtr );
+        displayPtr->mBlinkCount--;
+        if( 0 < displayPtr->mBlinkCount && 0 != displayPtr->mBlinkMask )
+        {
+
+            displayPtr->mBlinkHidden = !displayPtr->mBlinkHidden;
+            mTimerWheel.Schedule( displayPtr->mBlinkTimer, mBlinkInterval );
+
+        }
+        else
+        {
+
+            displayPtr->mBlinkHidden = false;
+            displayPtr->mBlinkMask = 0;
+
+        }
+
+    }
+
+    //! Draws status condition icons
+    /*!
+        DrawIcons() draws the icons of the given conditions from the iconset atlas onto an Image,
+        in order of condition ID, filling the bottom row of the strip first. Turn counters above 0
+        are drawn onto the lower right corner of their icons from the cached counter strips.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the destination Image
+        \param rY : (int) Y coordinate of the icon strip in the destination Image
+        \param rMask : (unsigned int) Condition mask of the icons to draw
+        \param rTurnsPtr : (const unsigned char *) Pointer to the turn counters (NULL = no counters)
+    */
+    static void DrawIcons( RPG::Image * rImagePtr, int rY, unsigned int rMask, const unsigned char * rTurnsPtr )
+    {
+
+        int slot;               // Position of the next icon in the strip
+        int condition;          // Zero-based condition index of the next icon
+        int perRow;             // Number of icons per row of the iconset atlas
+        int x, y;               // Coordinates of the icon in the destination Image
+
+        if( NULL == mIconSetPtr )
+        {
+
+            return;
+
+        }
+        perRow = mIconSetPtr->width / ICON_SIZE;
+        for( slot = 0; 0 != rMask && slot < ICONS_PER_ROW * ICON_ROWS; slot++ )
+        {
+
+            condition = __builtin_ctz( rMask );
+            rMask &= rMask - 1;
+            x = ( slot % ICONS_PER_ROW ) * ICON_SIZE;
+            y = rY + ICON_STRIP_HEIGHT - ( slot / ICONS_PER_ROW + 1 ) * ICON_SIZE;
+            rImagePtr->draw( x, y,                                                      // Coordinates in destination Image
+                             mIconSetPtr,                                               // Source Image pointer
+                             ( condition % perRow ) * ICON_SIZE,                        // Coordinates in source Image
+                             ( condition / perRow ) * ICON_SIZE,
+                             ICON_SIZE, ICON_SIZE,                                      // Dimensions in source Image
+                             0);                                                        // Transparency color
+            if( NULL != rTurnsPtr && 0 < rTurnsPtr[condition] )
+            {
+
+                rImagePtr->draw( x + ICON_SIZE - COUNTER_SIZE, y + ICON_SIZE - COUNTER_SIZE,    // Coordinates in destination Image
+                                 mCounterPtr[rTurnsPtr[condition]],                     // Source Image pointer
+                                 0, 0,                                                  // Coordinates in source Image
+                                 COUNTER_SIZE, COUNTER_SIZE,                            // Dimensions in source Image
+                                 0);                                                    // Transparency color
+
+            }
+
+        }
+
+    }
+
+    //! Clears a rectangle of the display Image
+    /*!
+        ClearRect() sets a rectangle of the display Image to the transparency color, so that part
+        of the Image can be redrawn without clearing all of it. The pixel rows of an Image are
+        stored contiguously, one byte per pixel.
+
+        \param rX : (int) X coordinate of the rectangle
+        \param rY : (int) Y coordinate of the rectangle
+        \param rWidth : (int) Width of the rectangle
+        \param rHeight : (int) Height of the rectangle
+    */
+    void ClearRect( int rX, int rY, int rWidth, int rHeight )
+    {
+
+        int row;        // Index variable
+
+        for( row = rY; row < rY + rHeight; row++ )
+        {
+
+            memset( mDisplayPtr->pixels + row * mDisplayPtr->width + rX, 0, rWidth );
+
+        }
+
+    }
+
+    //! Records a change of HP
+    /*!
+        ObserveHealth() compares the Battler's HP to when it was last observed and records the
+        difference, if any, in the change accumulator.
+    */
+    void ObserveHealth()
+    {
+
+        int change;             // HP change since the last observation
+
+        change = mBattlerPtr->hp - mObservedHealth;
+        if( 0 == change )
+        {
+
+            return;
+
+        }
+        if( mNumChanges < MAX_CHANGES )
+        {
+
+            mChange[mNumChanges++] = change;
+
+        }
+        else
+        {
+
+            mChange[MAX_CHANGES - 1] += change;
+
+        }
+        mObservedHealth = mBattlerPtr->hp;
+
+    }
+
+    //! Shows popups for the accumulated HP changes
+    /*!
+        ShowChanges() spawns popups for the changes in the accumulator: one for the net change,
+        or with PopupEachChange one per change, stacked upwards.
+    */
+    void ShowChanges()
+    {
+
+        int i;                  // Index variable
+        int net;                // Net change of HP
+        int shown;              // Number of popups spawned
+
+        if( !mPopupEachChange )
+        {
+
+            net = mObservedHealth - mCurHealth;
+            if( 0 > net || ( mPopupHeals && 0 < net ) )
+            {
+
+                SpawnPopup( mBattlerPtr->x, mBattlerPtr->y, net );
+
+            }
+            return;
+
+        }
+        shown = 0;
+        for( i = 0; i < mNumChanges; i++ )
+        {
+
+            if( 0 > mChange[i] || ( mPopupHeals && 0 < mChange[i] ) )
+            {
+
+                SpawnPopup( mBattlerPtr->x, mBattlerPtr->y - shown * DIGIT_HEIGHT, mChange[i] );
+                shown++;
+
+            }
+
+        }
+
+    }
+
+    //! Shows a popup
+    /*!
+        SpawnPopup() takes the next popup from the pool, which is the oldest one, and starts it
+        for this BattleDisplay. The sign of the change is not shown; the digits are those of the SystemGraphic.
+
+        \param rX : (int) X coordinate of the center of the number on the Canvas
+        \param rY : (int) Y coordinate of the number on the Canvas
+        \param rChange : (int) Change of HP to show
+    */
+    void SpawnPopup( int rX, int rY, int rChange )
+    {
+
+        Popup * popupPtr;       // Popup to start
+        int value;              // Remaining part of the number
+        int digit;              // Index variable
+
+        if( 0 >= mPopupFrames )
+        {
+
+            return;
+
+        }
+        popupPtr = &mPopup[mNextPopup];
+        mNextPopup = ( mNextPopup + 1 ) % MAX_POPUPS;
+        value = ( 0 > rChange ) ? -rChange : rChange;
+        // Count the digits, then fill them in from the least significant one
+        popupPtr->mNumDigits = 1;
+        for( digit = value / 10; 0 < digit && popupPtr->mNumDigits < MAX_POPUP_DIGITS; digit /= 10 )
+        {
+
+            popupPtr->mNumDigits++;
+
+        }
+        for( digit = popupPtr->mNumDigits - 1; 0 <= digit; digit-- )
+        {
+
+            popupPtr->mDigit[digit] = value % 10;
+            value /= 10;
+
+        }
+        popupPtr->mX = rX;
+        popupPtr->mY = rY - DIGIT_HEIGHT;
+        popupPtr->mAge = 0;
+        popupPtr->mOwnerPtr = this;
+
+    }
+
+    //! Gets the Images from the battle arena
+    /*!
+        AcquireImages() gets the display Image and the icon strip from the battle arena, unless
+        the BattleDisplay already has them in this battle. If it got any, the arena may have
+        grown, so the memory budget is checked.
+
+        \return (bool) true if the BattleDisplay has its Images
+    */
+    bool AcquireImages()
+    {
+
+        bool acquired;          // Whether any Image was taken from the arena
+
+        acquired = ( NULL == mDisplayPtr || NULL == mIconStripPtr );
+        if( NULL == mDisplayPtr )
+        {
+
+            mDisplayPtr = mBattleArena.Acquire( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+            if( NULL == mDisplayPtr )
+            {
+
+                return false;
+
+            }
+            mDisplayPtr->useMaskColor = true;
+
+        }
+        if( NULL == mIconStripPtr )
+        {
+
+            mIconStripPtr = mBattleArena.Acquire( DISPLAY_WIDTH, ICON_STRIP_HEIGHT );
+
+        }
+        if( acquired )
+        {
+
+            EnforceBudget( false );
+
+        }
+        return NULL != mIconStripPtr;
+
+    }
+
+    //! Gives the Images back to the battle arena
+    /*!
+        ReleaseImages() is for BattleDisplays which are done before the battle ends, like the one
+        of the golden-image test, so their Images do not stay in use until the arena is reset.
+    */
+    void ReleaseImages()
+    {
+
+        mBattleArena.Release( mDisplayPtr );
+        mBattleArena.Release( mIconStripPtr );
+        mDisplayPtr = NULL;
+        mIconStripPtr = NULL;
+
+    }
+
+    //! Forces a full redraw
+    /*!
+        Invalidate() marks everything on the display Image as out of date, so the next call to
+        Draw() redraws all of it.
+    */
+    void Invalidate()
+    {
+
+        mInvalid = true;
+        mIconsInvalid = true;
+
+    }
+
+    //! Checks whether an element is shown
+    /*!
+        \param rElement : (int) Index of the display element
+        \return (bool) true if both the layout and the policy of this BattleDisplay show the element
+    */
+    bool Shows( int rElement )
+    {
+
+        return mShowElement[rElement] && 0 != ( mElements & ( 1 << rElement ) );
+
+    }
+
+    //! Gets the width of the background panel
+    /*!
+        \return (int) Width of the shown elements: gauge numbers end at the right edge of the
+                 display Image and the icon strip is as wide as a row of icons, while gauges
+                 alone are only as wide as the gauge
+    */
+    int PanelWidth()
+    {
+
+        bool numbers;           // Whether any gauge shows a number
+
+        numbers = ( Shows( GAUGE_HEALTH ) && ( mShowNumbers || 0 < mLayerHealth ) )
+                  || ( mShowNumbers && ( Shows( GAUGE_MANA ) || Shows( GAUGE_ATB ) ) );
+        if( numbers )
+        {
+
+            return NUMBER_X + NUMBER_CELLS * COUNTER_SIZE;
+
+        }
+        return Shows( ELEMENT_ICONS ) ? ICONS_PER_ROW * ICON_SIZE : mGaugeWidth;
+
+    }
+
+    //! Checks whether the display Image is up to date with the conditions and color variants
+    /*!
+        \return (bool) true if Draw() has nothing to do for the conditions, turn counters and variants
+    */
+    bool Settled()
+    {
+
+        return VisibleConditions() == mDrawnIconMask && !mTurnsChanged && Variants() == mDrawnVariants;
+
+    }
+
+    //! Compiles the display list
+    /*!
+        CompileDisplayList() turns the layout into the display list: the shown elements are
+        stacked upwards from the bottom of the display Image in element order, and each gets a
+        command with its position and value sources resolved. It must be called whenever the
+        layout or the Battler changes; Draw() does so by itself when the layout version changed.
+    */
+    void CompileDisplayList()
+    {
+
+        const static int GAUGE_SHIFT[NUM_GAUGES] = { 0, FIXED_SHIFT, 0 };              // Fractional bits of the gauge values
+
+        int element;            // Index variable
+        int y;                  // Bottom of the next element
+        DisplayCommand * commandPtr;    // Command being compiled
+        const int * value[NUM_GAUGES] = { &mLayerValue, &mShownMana, &mCurATB };       // Displayed values of the gauges (health within its layer)
+        const int * maximum[NUM_GAUGES] = { &mLayerMax, &mMaxMana, &mMaxATB };         // Maximum values of the gauges
+        const int * ghost[NUM_GAUGES] = { &mLayerGhost, &mNoGhost, &mNoGhost };        // Damage ghost values of the gauges
+
+        mNumCommands = 0;
+        y = DISPLAY_HEIGHT;
+        for( element = 0; element < NUM_ELEMENTS; element++ )
+        {
+
+            if( !Shows( element ) )
+            {
+
+                continue;
+
+            }
+            commandPtr = &mCommand[mNumCommands++];
+            if( ELEMENT_ICONS == element )
+            {
+
+                commandPtr->mType = COMMAND_ICONS;
+                commandPtr->mHeight = ICON_STRIP_HEIGHT;
+                commandPtr->mGauge = 0;
+                commandPtr->mValuePtr = NULL;
+                commandPtr->mValueShift = 0;
+                commandPtr->mMaxPtr = NULL;
+                commandPtr->mGhostPtr = NULL;
+                commandPtr->mPercent = false;
+
+            }
+            else
+            {
+
+                commandPtr->mType = COMMAND_GAUGE;
+                commandPtr->mHeight = GAUGE_HEIGHT;
+                commandPtr->mGauge = element;
+                commandPtr->mValuePtr = value[element];
+                commandPtr->mValueShift = GAUGE_SHIFT[element];
+                commandPtr->mMaxPtr = maximum[element];
+                commandPtr->mGhostPtr = ghost[element];
+                commandPtr->mPercent = ( GAUGE_ATB == element );
+
+            }
+            y -= commandPtr->mHeight;
+            commandPtr->mY = y;
+
+        }
+        mPanelTop = y;
+        mCompiledVersion = mLayoutVersion;
+        Invalidate();
+
+    }
+
+    //! Moves the display above the opaque part of a monster's graphic
+    /*!
+        AnchorToSprite() adds the offset which centers the display horizontally on the opaque
+        part of the monster's graphic and puts its bottom on the top of that part, instead of on
+        the middle of the graphic. The graphic is centered on the monster's coordinates. Only the
+        first monster using a graphic has it measured; if it cannot be measured, the offsets stay
+        as they are.
+
+        \param rDatabaseId : (int) Database ID of the monster
+        \return (bool) true if the graphic was measured and the offsets changed
+    */
+    bool AnchorToSprite( int rDatabaseId )
+    {
+
+        RPG::DBMonster * monsterPtr;    // Database entry of the monster
+        SpriteMetrics::Bounds bounds;   // Opaque bounds of its graphic
+
+        monsterPtr = RPG::dbMonsters[rDatabaseId];
+        if( NULL == monsterPtr || !SpriteMetrics::Find( monsterPtr->filename.s_str().c_str(), bounds ) )
+        {
+
+            return false;
+
+        }
+        mOffsetX += ( bounds.mLeft + bounds.mRight ) / 2 - bounds.mWidth / 2;
+        mOffsetY += bounds.mTop - bounds.mHeight / 2;
+        return true;
+
+    }
+
+    //! Sets the number of layers of the health gauge
+    /*!
+        SetLayers() splits the maximum health into layers of equal capacity, rounded up, so only
+        the topmost layer may hold less. One layer is an ordinary health gauge. SetGaugeWidth()
+        must be called afterwards, as layers need their tinted bars.
+
+        \param rLayers : (int) Number of layers
+    */
+    void SetLayers( int rLayers )
+    {
+
+        if( 1 >= rLayers || 1 >= mMaxHealth )
+        {
+
+            mLayerHealth = 0;
+            mTopLayer = 0;
+
+        }
+        else
+        {
+
+            mLayerHealth = ( mMaxHealth + rLayers - 1 ) / rLayers;
+            mTopLayer = ( mMaxHealth - 1 ) / mLayerHealth;
+
+        }
+        mSplitHealth = -1;
+        mLayer = 0;
+        mLayersLeft = 0;
+        mCompiledVersion = -1;
+
+    }
+
+    //! Finds the layer of the displayed health
+    /*!
+        SplitLayers() updates the layer, the health within it and the damage ghost within it.
+        The layer and the health within it come from a single division, done only when the
+        displayed health changed. Without layers, the layer is the whole gauge.
+    */
+    void SplitLayers()
+    {
+
+        int health;             // Displayed health
+        int ghost;              // Damage ghost within the layer
+
+        health = mShownHealth >> FIXED_SHIFT;
+        if( 0 >= mLayerHealth )
+        {
+
+            mLayerValue = health;
+            mLayerMax = mMaxHealth;
+            mLayerGhost = mGhostHealth;
+            return;
+
+        }
+        if( health != mSplitHealth )
+        {   // Health at a layer boundary fills the lower layer
+
+            mSplitHealth = health;
+            mLayer = ( 0 < health ) ? ( health - 1 ) / mLayerHealth : 0;
+            mLayersLeft = ( 0 < health ) ? mLayer + 1 : 0;
+            mLayerValue = health - mLayer * mLayerHealth;
+            mLayerMax = ( mTopLayer == mLayer ) ? mMaxHealth - mLayer * mLayerHealth : mLayerHealth;
+
+        }
+        ghost = ( mGhostHealth >> FIXED_SHIFT ) - mLayer * mLayerHealth;
+        mLayerGhost = ( ( ghost < 0 ) ? 0 : ( ( ghost > mLayerMax ) ? mLayerMax : ghost ) ) << FIXED_SHIFT;
+
+    }
+
+    //! Gets the number shown beside the health gauge
+    /*!
+        \return (int) The layer counter for layered gauges, otherwise as GaugeNumber()
+    */
+    int HealthNumber()
+    {
+
+        return ( 0 < mLayerHealth ) ? mLayersLeft : GaugeNumber( mShownHealth >> FIXED_SHIFT, mMaxHealth, false );
+
+    }
+
+    //! Gets the gauge width for a Battler
+    /*!
+        \param rMaxHealth : (int) Maximum health of the Battler
+        \return (int) GaugeWidth, or if HealthPerPixel is set, the maximum health divided by it,
+                 rounded down to a multiple of GAUGE_WIDTH_STEP so few widths need frames
+    */
+    static int GaugeWidthFor( int rMaxHealth )
+    {
+
+        if( 0 >= mHealthPerPixel )
+        {
+
+            return mGaugeWidthSetting;
+
+        }
+        return rMaxHealth / mHealthPerPixel / GAUGE_WIDTH_STEP * GAUGE_WIDTH_STEP;
+
+    }
+
+    //! Sets the width of the gauges
+    /*!
+        SetGaugeWidth() clamps the width to what fits beside the numbers, gets the frames and
+        bars of that width from the cache, with the tinted bars of a layered health gauge, and
+        invalidates the display. If the cache is full, the gauges keep the standard width and the
+        layers go untinted.
+
+        \param rWidth : (int) Width of the gauges
+    */
+    void SetGaugeWidth( int rWidth )
+    {
+
+        int kind;               // Index variable
+        int kinds;              // Number of frame kinds needed
+        int maxWidth;           // Widest gauge which fits
+        GaugeFrames * framesPtr[NUM_FRAME_KINDS];       // Frames of each kind
+
+        maxWidth = ( mShowNumbers || 0 < mLayerHealth ) ? NUMBER_X : DISPLAY_WIDTH;
+        rWidth = ( rWidth < MIN_GAUGE_WIDTH ) ? MIN_GAUGE_WIDTH : ( ( rWidth > maxWidth ) ? maxWidth : rWidth );
+        kinds = ( 0 < mLayerHealth ) ? NUM_FRAME_KINDS : NUM_GAUGES;
+        for( kind = 0; kind < kinds; kind++ )
+        {
+
+            framesPtr[kind] = AcquireFrames( kind, rWidth );
+            if( NULL == framesPtr[kind] )
+            {
+
+                break;
+
+            }
+
+        }
+        if( kinds > kind )
+        {   // Cache is full; the standard frames are always in it
+
+            rWidth = GAUGE_WIDTH;
+            for( kind = 0; kind < kinds; kind++ )
+            {
+
+                framesPtr[kind] = &mFrames[( NUM_GAUGES > kind ) ? kind : GAUGE_HEALTH];
+
+            }
+
+        }
+        for( kind = 0; kind < NUM_GAUGES; kind++ )
+        {
+
+            mFramesPtr[kind] = framesPtr[kind];
+
+        }
+        mLayerFramesPtr[0] = framesPtr[GAUGE_HEALTH];
+        for( kind = 1; kind < NUM_LAYER_TINTS; kind++ )
+        {
+
+            mLayerFramesPtr[kind] = ( 0 < mLayerHealth ) ? framesPtr[NUM_GAUGES + kind - 1] : framesPtr[GAUGE_HEALTH];
+
+        }
+        mGaugeWidth = rWidth;
+        Invalidate();
+
+    }
+
+    //! Gets the frame and bars of a gauge at a width
+    /*!
+        AcquireFrames() looks the kind and width up in the frame cache and marks the entry as used
+        in this battle. On a miss, the frame and the bars are nine-sliced from the standard width
+        Images into new Images of the width and encoded, once; after that, a gauge of this width
+        is drawn like a standard one. The grown cache is checked against the memory budget. The kinds
+        after the gauges are the boss layers: health bars remapped to a layer tint.
+
+        \param rKind : (int) Index of the gauge, or NUM_GAUGES + tint - 1 for a layer tint
+        \param rWidth : (int) Width of the frame and bars
+        \return (GaugeFrames *) Pointer to the cache entry, or NULL if the cache is full
+    */
+    static GaugeFrames * AcquireFrames( int rKind, int rWidth )
+    {
+
+        int i;                  // Index variable
+        int gauge;              // Index of the gauge the frames are made of
+        GaugeFrames * framesPtr;// New cache entry
+
+        framesPtr = NULL;
+        for( i = 0; i < mNumFrames; i++ )
+        {
+
+            if( rKind == mFrames[i].mGauge && rWidth == mFrames[i].mWidth )
+            {
+
+                mFrames[i].mUsedIn = mBattleArena.Generation();
+                return &mFrames[i];
+
+            }
+            if( NULL == framesPtr && 0 == mFrames[i].mWidth )
+            {   // Entry freed by EnforceBudget()
+
+                framesPtr = &mFrames[i];
+
+            }
+
+        }
+        if( NULL == framesPtr && MAX_FRAMES == mNumFrames )
+        {
+
+            return NULL;
+
+        }
+        gauge = ( NUM_GAUGES > rKind ) ? rKind : GAUGE_HEALTH;
+        framesPtr = ( NULL != framesPtr ) ? framesPtr : &mFrames[mNumFrames++];
+        framesPtr->mUsedIn = mBattleArena.Generation();
+        framesPtr->mGauge = rKind;
+        framesPtr->mWidth = rWidth;
+        framesPtr->mGaugePtr = RPG::Image::create( rWidth, GAUGE_HEIGHT );
+        framesPtr->mBarAPtr = RPG::Image::create( rWidth, BAR_HEIGHT );
+        framesPtr->mBarBPtr = RPG::Image::create( rWidth, BAR_HEIGHT );
+        Blitter::NineSlice( framesPtr->mGaugePtr, 0, 0, rWidth, GAUGE_HEIGHT,
+                            mFrames[gauge].mGaugePtr, 0, 0, GAUGE_WIDTH, GAUGE_HEIGHT, SLICE_BORDER );
+        Blitter::NineSlice( framesPtr->mBarAPtr, 0, 0, rWidth, BAR_HEIGHT,
+                            mFrames[gauge].mBarAPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, SLICE_BORDER );
+        Blitter::NineSlice( framesPtr->mBarBPtr, 0, 0, rWidth, BAR_HEIGHT,
+                            mFrames[gauge].mBarBPtr, 0, 0, BAR_WIDTH, BAR_HEIGHT, SLICE_BORDER );
+        if( gauge != rKind )
+        {
+
+            Blitter::Remap( framesPtr->mBarAPtr, 0, 0, rWidth, BAR_HEIGHT, mLayerRemap[rKind - NUM_GAUGES + 1] );
+            Blitter::Remap( framesPtr->mBarBPtr, 0, 0, rWidth, BAR_HEIGHT, mLayerRemap[rKind - NUM_GAUGES + 1] );
+
+        }
+        framesPtr->mGaugeSprite.Build( framesPtr->mGaugePtr, 0, 0, rWidth, GAUGE_HEIGHT, Sprite::CLASS_GAUGE );
+        framesPtr->mBarASprite.Build( framesPtr->mBarAPtr, 0, 0, rWidth, BAR_HEIGHT, Sprite::CLASS_BAR );
+        framesPtr->mBarBSprite.Build( framesPtr->mBarBPtr, 0, 0, rWidth, BAR_HEIGHT, Sprite::CLASS_BAR );
+        EnforceBudget( false );
+        return framesPtr;
+
+    }
+
+    //! Destroys a cache entry of composed gauge frames
+    /*!
+        FreeFrames() destroys the Images of the entry and marks it free, so AcquireFrames() can
+        use it for other frames.
+
+        \param rFrames : (GaugeFrames &) Entry to free
+    */
+    static void FreeFrames( GaugeFrames & rFrames )
+    {
+
+        RPG::Image::destroy( rFrames.mGaugePtr );
+        RPG::Image::destroy( rFrames.mBarAPtr );
+        RPG::Image::destroy( rFrames.mBarBPtr );
+        rFrames.mGauge = -1;
+        rFrames.mWidth = 0;
+
+    }
+
+    //! Draws one gauge from the encoded sprites
+    /*!
+        DrawGaugeFast() draws a gauge onto the display Image from the run-length encoded sprites,
+        using bar B when the bar is full and bar A otherwise. A trailing segment up to the ghost
+        fill is drawn with bar B, so recently lost health stands out. The bar of a layered health
+        gauge is drawn in the tint of its layer, over the full bar of the layer below.
+
+        \param rY : (int) Y coordinate of the gauge in the display Image
+        \param rGauge : (int) Index of the gauge (GAUGE_HEALTH, GAUGE_MANA or GAUGE_ATB)
+        \param rFill : (int) Width of the filled part of the bar
+        \param rGhostFill : (int) Width up to which the damage ghost is drawn (no ghost if not more than rFill)
+    */
+    void DrawGaugeFast( int rY, int rGauge, int rFill, int rGhostFill )
+    {
+
+        int layer;              // Layer of the bar
+        GaugeFrames * barsPtr;  // Bars in the tint of the layer, at the width of this display
+
+        layer = ( GAUGE_HEALTH == rGauge ) ? mLayer : 0;
+        barsPtr = ( GAUGE_HEALTH == rGauge ) ? mLayerFramesPtr[layer % NUM_LAYER_TINTS] : mFramesPtr[rGauge];
+
+        mFramesPtr[rGauge]->mGaugeSprite.Draw( mDisplayPtr, 0, rY );
+        if( 0 < layer )
+        {   // The layer below shows through as a full bar
+
+            mLayerFramesPtr[( layer - 1 ) % NUM_LAYER_TINTS]->mBarBSprite.Draw( mDisplayPtr, 0, rY );
+
+        }
+        if( 0 < rFill )
+        {
+
+            ( ( mGaugeWidth == rFill ) ? barsPtr->mBarBSprite : barsPtr->mBarASprite ).DrawColumns( mDisplayPtr, 0, rY, 0, rFill );
+
+        }
+        if( rGhostFill > rFill )
+        {
+
+            barsPtr->mBarBSprite.DrawColumns( mDisplayPtr, rFill, rY, rFill, rGhostFill );
+
+        }
+
+    }
+
+    //! Composes the icon strip
+    /*!
+        ComposeStrip() draws the icons of the given conditions, with their turn counters, onto the
+        cached icon strip Image from the encoded sprites, in the same layout as DrawIcons().
+
+        \param rMask : (unsigned int) Condition mask of the icons to draw
+    */
+    void ComposeStrip( unsigned int rMask )
+    {
+
+        int slot;               // Position of the next icon in the strip
+        int condition;          // Zero-based condition index of the next icon
+        int x, y;               // Coordinates of the icon in the strip
+
+        mIconStripPtr->clear();
+        if( NULL == mIconSetPtr )
+        {
+
+            return;
+
+        }
+        for( slot = 0; 0 != rMask && slot < ICONS_PER_ROW * ICON_ROWS; slot++ )
+        {
+
+            condition = __builtin_ctz( rMask );
+            rMask &= rMask - 1;
+            x = ( slot % ICONS_PER_ROW ) * ICON_SIZE;
+            y = ICON_STRIP_HEIGHT - ( slot / ICONS_PER_ROW + 1 ) * ICON_SIZE;
+            if( mIconSprite[condition].IsBuilt() )
+            {
+
+                mIconSprite[condition].Draw( mIconStripPtr, x, y );
+
+            }
+            if( mShowCounters && 0 < mConditionTurns[condition] )
+            {
+
+                mCounterSprite[mConditionTurns[condition]].Draw( mIconStripPtr, x + ICON_SIZE - COUNTER_SIZE, y + ICON_SIZE - COUNTER_SIZE );
+
+            }
+
+        }
+
+    }
+
+    //! Redraws a gauge if needed
+    /*!
+        RefreshGauge() redraws a gauge on the display Image if its bar or damage ghost changed
+        since it was last drawn.
+
+        \param rState : (DisplayCommand &) Command whose drawn state is checked and updated
+        \param rY : (int) Y coordinate of the gauge in the display Image
+        \param rGauge : (int) Index of the gauge (GAUGE_HEALTH, GAUGE_MANA or GAUGE_ATB)
+        \param rFill : (int) Width of the filled part of the bar
+        \param rGhostFill : (int) Width up to which the damage ghost is drawn
+        \param rNumber : (int) Number shown beside the gauge (-1 = none)
+    */
+    void RefreshGauge( DisplayCommand & rState, int rY, int rGauge, int rFill, int rGhostFill, int rNumber )
+    {
+
+        int cell;               // Index variable
+        int variant;            // Color variant of the gauge
+        int numberVariant;      // Color variant of the number
+        int layer;              // Layer of the bar
+
+        variant = GaugeVariant( rGauge );
+        layer = ( GAUGE_HEALTH == rGauge ) ? mLayer : 0;
+        numberVariant = NumberVariant( rGauge );
+        if( variant != rState.mDrawnVariant )
+        {   // The whole gauge is drawn again in its new colors
+
+            rState.mDrawnFill = -1;
+            rState.mDrawnVariant = variant;
+
+        }
+        if( numberVariant != rState.mDrawnNumberVariant )
+        {
+
+            for( cell = 0; cell < NUMBER_CELLS; cell++ )
+            {
+
+                rState.mDrawnGlyph[cell] = STALE_GLYPH;
+
+            }
+            rState.mDrawnNumber = -1;
+            rState.mDrawnNumberVariant = numberVariant;
+
+        }
+        if( rFill != rState.mDrawnFill || rGhostFill != rState.mDrawnGhostFill || layer != rState.mDrawnLayer )
+        {
+
+            ClearRect( 0, rY, mGaugeWidth, GAUGE_HEIGHT );
+            DrawGaugeFast( rY, rGauge, rFill, rGhostFill );
+            if( VARIANT_NORMAL != variant )
+            {
+
+                Blitter::Remap( mDisplayPtr, 0, rY, mGaugeWidth, GAUGE_HEIGHT, mRemap[variant] );
+
+            }
+            rState.mDrawnFill = rFill;
+            rState.mDrawnGhostFill = rGhostFill;
+            rState.mDrawnLayer = layer;
+
+        }
+        if( rNumber != rState.mDrawnNumber )
+        {
+
+            if( 0 <= rNumber )
+            {
+
+                DecomposeNumber( rNumber, rState.mGlyph );
+
+            }
+            else
+            {
+
+                for( cell = 0; cell < NUMBER_CELLS; cell++ )
+                {
+
+                    rState.mGlyph[cell] = NO_GLYPH;
+
+                }
+
+            }
+            // Only the cells whose glyph changed are touched; cells which became empty are just
+            // cleared
+            for( cell = 0; cell < NUMBER_CELLS; cell++ )
+            {
+
+                if( rState.mGlyph[cell] != rState.mDrawnGlyph[cell] )
+                {
+
+                    ClearRect( NUMBER_X + cell * COUNTER_SIZE, rY, COUNTER_SIZE, COUNTER_SIZE );
+                    if( NO_GLYPH != rState.mGlyph[cell] )
+                    {
+
+                        mCounterSprite[rState.mGlyph[cell]].Draw( mDisplayPtr, NUMBER_X + cell * COUNTER_SIZE, rY );
+                        if( VARIANT_NORMAL != numberVariant )
+                        {
+
+                            Blitter::Remap( mDisplayPtr, NUMBER_X + cell * COUNTER_SIZE, rY, COUNTER_SIZE, COUNTER_SIZE, mRemap[numberVariant] );
+
+                        }
+
+                    }
+                    rState.mDrawnGlyph[cell] = rState.mGlyph[cell];
+
+                }
+
+            }
+            rState.mDrawnNumber = rNumber;
+
+        }
+
+    }
+
+    //! Gets the color variant of a gauge
+    /*!
+        \param rGauge : (int) Index of the gauge
+        \return (int) Color variant: grey if the Battler is down, the hit flash for the health
+                 gauge, normal otherwise
+    */
+    int GaugeVariant( int rGauge )
+    {
+
+        if( 0 >= mCurHealth )
+        {
+
+            return VARIANT_GREY;
+
+        }
+        return ( GAUGE_HEALTH == rGauge && mFlashing ) ? VARIANT_FLASH : VARIANT_NORMAL;
+
+    }
+
+    //! Gets the color variant of the number of a gauge
+    /*!
+        \param rGauge : (int) Index of the gauge
+        \return (int) Color variant: grey if the Battler is down, red for the health number of a
+                 Battler low on health, normal otherwise
+    */
+    int NumberVariant( int rGauge )
+    {
+
+        if( 0 >= mCurHealth )
+        {
+
+            return VARIANT_GREY;
+
+        }
+        return ( GAUGE_HEALTH == rGauge && mCurHealth * 100 <= mMaxHealth * mLowHealthPercent ) ? VARIANT_LOW : VARIANT_NORMAL;
+
+    }
+
+    //! Gets all color variants
+    /*!
+        \return (int) The color variants of the health gauge and its number and of the other
+                 gauges, packed into one value for comparison
+    */
+    int Variants()
+    {
+
+        return ( GaugeVariant( GAUGE_HEALTH ) * NUM_VARIANTS + NumberVariant( GAUGE_HEALTH ) ) * NUM_VARIANTS + GaugeVariant( GAUGE_MANA );
+
+    }
+
+    //! Builds the remap tables of the color variants
+    /*!
+        BuildRemapTables() computes, for every color of a palette, the color of each variant and
+        the palette index closest to it. Index 0 is transparent and stays 0 in every table. The
+        boss layer tints are made the same way, by rotating the color components.
+
+        \param rPalettePtr : (const int *) Palette of 256 colors in 0x00RRGGBB format
+    */
+    static void BuildRemapTables( const int * rPalettePtr )
+    {
+
+        // Source component of each component of the boss layer tints: tint 1 turns red into
+        // green, tint 2 red into blue, tint 3 swaps red and blue
+        const static int ROTATION[NUM_LAYER_TINTS][3] = { { 0, 1, 2 }, { 2, 0, 1 }, { 1, 2, 0 }, { 2, 1, 0 } };
+
+        int i, c, variant;      // Index variables
+        int r, g, b;            // Components of the current color
+        int grey;               // Brightness of the current color
+        int source[3];          // Components of the current color, for the layer tints
+        int target[3];          // Components of the color wanted for the variant
+
+        for( i = 0; i < 256; i++ )
+        {
+
+            mRemap[VARIANT_NORMAL][i] = static_cast<unsigned char>( i );
+            mLayerRemap[0][i] = static_cast<unsigned char>( i );
+
+        }
+        for( variant = VARIANT_LOW; variant < NUM_VARIANTS; variant++ )
+        {
+
+            mRemap[variant][0] = 0;
+            for( i = 1; i < 256; i++ )
+            {
+
+                r = ( rPalettePtr[i] >> 16 ) & 0xFF;
+                g = ( rPalettePtr[i] >> 8 ) & 0xFF;
+                b = rPalettePtr[i] & 0xFF;
+                grey = ( r * 77 + g * 151 + b * 28 ) >> 8;
+                switch( variant )
+                {
+
+                case VARIANT_LOW:
+                    target[0] = grey / 2 + 128;
+                    target[1] = grey / 4;
+                    target[2] = grey / 4;
+                    break;
+                case VARIANT_GREY:
+                    target[0] = grey;
+                    target[1] = grey;
+                    target[2] = grey;
+                    break;
+                default:
+                    target[0] = ( r + 255 ) / 2;
+                    target[1] = ( g + 255 ) / 2;
+                    target[2] = ( b + 255 ) / 2;
+                    break;
+
+                }
+                mRemap[variant][i] = NearestColor( rPalettePtr, target );
+
+            }
+
+        }
+        for( variant = 1; variant < NUM_LAYER_TINTS; variant++ )
+        {
+
+            mLayerRemap[variant][0] = 0;
+            for( i = 1; i < 256; i++ )
+            {
+
+                source[0] = ( rPalettePtr[i] >> 16 ) & 0xFF;
+                source[1] = ( rPalettePtr[i] >> 8 ) & 0xFF;
+                source[2] = rPalettePtr[i] & 0xFF;
+                for( c = 0; c < 3; c++ )
+                {
+
+                    target[c] = source[ROTATION[variant][c]];
+
+                }
+                mLayerRemap[variant][i] = NearestColor( rPalettePtr, target );
+
+            }
+
+        }
+
+    }
+
+    //! Finds the palette color closest to a color
+    /*!
+        \param rPalettePtr : (const int *) Palette of 256 colors in 0x00RRGGBB format
+        \param rTarget : (const int *) Red, green and blue components of the color
+        \return (unsigned char) Index of the closest color, never the transparent index 0
+    */
+    static unsigned char NearestColor( const int * rPalettePtr, const int * rTarget )
+    {
+
+        int j;                  // Index variable
+        int r, g, b;            // Differences of the components of the current candidate
+        int distance, best;     // Squared distance to the current and the best candidate
+        unsigned char index;    // Index of the best candidate
+
+        best = -1;
+        index = 1;
+        for( j = 1; j < 256; j++ )
+        {
+
+            r = ( ( rPalettePtr[j] >> 16 ) & 0xFF ) - rTarget[0];
+            g = ( ( rPalettePtr[j] >> 8 ) & 0xFF ) - rTarget[1];
+            b = ( rPalettePtr[j] & 0xFF ) - rTarget[2];
+            distance = r * r + g * g + b * b;
+            if( -1 == best || distance < best )
+            {
+
+                best = distance;
+                index = static_cast<unsigned char>( j );
+
+            }
+
+        }
+        return index;
+
+    }
+
+    //! Ends the hit flash
+    /*!
+        \param rContextPtr : (void *) Pointer to the BattleDisplay
+    */
+    static void OnFlashTimer( void * rContextPtr )
+    {
+
+        static_cast<BattleDisplay *>( rContextPtr )->mFlashing = false;
+
+    }
+
+    //! Gets the number shown beside a gauge
+    /*!
+        \param rValue : (int) Displayed value of the gauge
+        \param rMax : (int) Maximum value of the gauge
+        \param rPercent : (bool) Whether to show the value in percent of the maximum
+        \return (int) Number to show, or -1 if gauges show no numbers
+    */
+    static int GaugeNumber( int rValue, int rMax, bool rPercent )
+    {
+
+        if( !mShowNumbers )
+        {
+
+            return -1;
+
+        }
+        if( rPercent )
+        {
+
+            return ( 0 < rMax ) ? rValue * 100 / rMax : 0;
+
+        }
+        return ( rValue > MAX_NUMBER ) ? MAX_NUMBER : rValue;
+
+    }
+
+    //! Splits a number into two-digit glyphs
+    /*!
+        DecomposeNumber() writes the glyph indices of a number into the cells of a gauge number,
+        right-aligned, from the last pair of digits to the first, so the alignment falls out of
+        the single pass. Each pair takes one division by 100 and a table lookup instead of two
+        divisions by 10; the first pair is the only one without leading zero.
+
+        \param rValue : (int) Number to split, 0 to MAX_NUMBER
+        \param rGlyphPtr : (int *) Array of NUMBER_CELLS glyph indices to fill
+    */
+    static void DecomposeNumber( int rValue, int * rGlyphPtr )
+    {
+
+        int cell;               // Index variable
+
+        cell = NUMBER_CELLS - 1;
+        while( 100 <= rValue )
+        {
+
+            rGlyphPtr[cell--] = mInnerPairGlyph[rValue % 100];
+            rValue /= 100;
+
+        }
+        rGlyphPtr[cell] = rValue;
+        while( 0 < cell )
+        {
+
+            rGlyphPtr[--cell] = NO_GLYPH;
+
+        }
+
+    }
+
+    //! Redraws the icon strip if needed
+    /*!
+        RefreshIcons() redraws the icon strip on the display Image if the visible conditions
+        changed; the strip itself is only composed again when its conditions differ from the last
+        composition.
+
+        \param rY : (int) Y coordinate of the icon strip in the display Image
+    */
+    void RefreshIcons( int rY )
+    {
+
+        unsigned int mask;      // Condition mask of the visible icons
+
+        mask = VisibleConditions();
+        if( mIconsInvalid || mask != mDrawnIconMask || mTurnsChanged )
+        {
+
+            if( mask != mStripMask || mTurnsChanged )
+            {
+
+                ComposeStrip( mask );
+                mStripMask = mask;
+                mTurnsChanged = false;
+
+            }
+            // The strip covers its whole area, transparent pixels included, so it can simply be
+            // copied instead of clearing the area and drawing it with a transparency test
+            Blitter::CopyRows( mDisplayPtr, 0, rY, mIconStripPtr, 0, 0, DISPLAY_WIDTH, ICON_STRIP_HEIGHT );
+            mDrawnIconMask = mask;
+            mIconsInvalid = false;
+
+        }
+
+    }
+
+    //! Draws the display image
+    /*!
+        This method draws the display Image based on the relevant data and display rules and puts
+        it on the Canvas. It walks the display list, and each command only redraws its area if
+        what it shows changed since the last call; DrawReference() is the straightforward version
+        which the results must match. Builds with DYNGAUGE_FIXED_LAYOUT draw with DrawFixed()
+        instead, using the layout of Policy.
+    */
+    template <class Policy>
+    void Draw()
+    {
+
+        DisplayCommand * commandPtr;    // Current command
+        int cell;               // Index variable
+        bool icons;             // Whether the display has an icon strip
+
+        RestoreCaches();
+        if( mCompiledVersion != mLayoutVersion )
+        {
+
+            CompileDisplayList();
+
+        }
+        // After an invalidation, start over from a blank Image
+        if( mInvalid )
+        {
+
+            mDisplayPtr->clear();
+            for( commandPtr = mCommand; commandPtr < mCommand + NUM_ELEMENTS; commandPtr++ )
+            {
+
+                commandPtr->mDrawnFill = -1;
+                commandPtr->mDrawnGhostFill = -1;
+                commandPtr->mDrawnNumber = -1;
+                commandPtr->mDrawnVariant = VARIANT_NORMAL;
+                commandPtr->mDrawnNumberVariant = VARIANT_NORMAL;
+                commandPtr->mDrawnLayer = -1;
+                for( cell = 0; cell < NUMBER_CELLS; cell++ )
+                {
+
+                    commandPtr->mDrawnGlyph[cell] = NO_GLYPH;
+
+                }
+
+            }
+            mInvalid = false;
+
+        }
+        mDrawnVariants = Variants();
+        SplitLayers();
+#ifdef DYNGAUGE_FIXED_LAYOUT
+        DrawFixed<typename Policy::Layout>();
+        icons = ( 0 != Policy::Layout::SHOW_ICONS );
+#else
+        icons = false;
+        for( commandPtr = mCommand; commandPtr < mCommand + mNumCommands; commandPtr++ )
+        {
+
+            switch( commandPtr->mType )
+            {
+
+            case COMMAND_GAUGE:
+                RefreshGauge( *commandPtr, commandPtr->mY, commandPtr->mGauge,
+                              BarFill( *commandPtr->mValuePtr >> commandPtr->mValueShift, *commandPtr->mMaxPtr, mGaugeWidth ),
+                              BarFill( *commandPtr->mGhostPtr >> FIXED_SHIFT, *commandPtr->mMaxPtr, mGaugeWidth ),
+                              ( GAUGE_HEALTH == commandPtr->mGauge ) ? HealthNumber()
+                                  : GaugeNumber( *commandPtr->mValuePtr >> commandPtr->mValueShift, *commandPtr->mMaxPtr, commandPtr->mPercent ) );
+                break;
+            case COMMAND_ICONS:
+                RefreshIcons( commandPtr->mY );
+                icons = true;
+                break;
+
+            }
+
+        }
+#endif
+        if( !icons )
+        {   // Nothing shows the conditions, so they are as good as drawn; otherwise a condition
+            // or turn change would keep the display from ever settling
+
+            mDrawnIconMask = VisibleConditions();
+            mTurnsChanged = false;
+
+        }
+
+    }
+
+    //! Draws the display image with a fixed layout
+    /*!
+        DrawFixed() does what the display list walk in Draw() does, for a layout known at compile
+        time. Layout is a class like the ones GenerateLayout() writes: every condition below is a
+        constant, so the compiler removes the elements which are not shown and folds the
+        coordinates into the calls. The commands serve only as drawn state, one per element.
+    */
+    template <class Layout>
+    void DrawFixed()
+    {
+
+        if( Layout::SHOW_HEALTH )
+        {
+
+            RefreshGauge( mCommand[GAUGE_HEALTH], Layout::HEALTH_Y, GAUGE_HEALTH,
+                          BarFill( mLayerValue, mLayerMax, mGaugeWidth ),
+                          BarFill( mLayerGhost >> FIXED_SHIFT, mLayerMax, mGaugeWidth ),
+                          HealthNumber() );
+
+        }
+        if( Layout::SHOW_MANA )
+        {
+
+            RefreshGauge( mCommand[GAUGE_MANA], Layout::MANA_Y, GAUGE_MANA, BarFill( mShownMana >> FIXED_SHIFT, mMaxMana, mGaugeWidth ), 0,
+                          GaugeNumber( mShownMana >> FIXED_SHIFT, mMaxMana, false ) );
+
+        }
+        if( Layout::SHOW_ATB )
+        {
+
+            RefreshGauge( mCommand[GAUGE_ATB], Layout::ATB_Y, GAUGE_ATB, BarFill( mCurATB, ATB_MAX, mGaugeWidth ), 0,
+                          GaugeNumber( mCurATB, ATB_MAX, true ) );
+
+        }
+        if( Layout::SHOW_ICONS )
+        {
+
+            RefreshIcons( Layout::ICONS_Y );
+
+        }
+
+    }
+
+    //! Draws the display image from scratch
+    /*!
+        DrawReference() is the reference renderer: it draws the complete display for the current
+        values onto the given Image without any caching or partial updates. It must stay as simple
+        as possible, since it is what the optimized Draw() path is checked against. The gauges
+        are worked out from the SystemGraphic pixel by pixel, not taken from the frame cache or
+        the remap tables, so those are checked as well.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the destination Image
+    */
+    void DrawReference( RPG::Image * rImagePtr )
+    {
+
+        int y;                  // Bottom of the next element
+        int health;             // Displayed health within its layer
+        int ghost;              // Damage ghost within the layer of the displayed health
+        int capacity;           // Capacity of that layer
+        int layer;              // Index of that layer
+
+        RestoreCaches();
+        if( !mReferenceReady )
+        {
+
+            BuildReferenceColors();
+
+        }
+        rImagePtr->clear();
+        y = DISPLAY_HEIGHT;
+        if( Shows( GAUGE_HEALTH ) )
+        {
+
+            y -= GAUGE_HEIGHT;
+            health = mShownHealth >> FIXED_SHIFT;
+            ghost = mGhostActive ? mGhostHealth >> FIXED_SHIFT : 0;
+            capacity = mMaxHealth;
+            layer = 0;
+            if( 0 < mLayerHealth )
+            {   // Peel off full layers one at a time, rather than dividing like SplitLayers()
+
+                while( health > mLayerHealth )
+                {
+
+                    health -= mLayerHealth;
+                    ghost -= mLayerHealth;
+                    layer++;
+
+                }
+                capacity = ( mTopLayer == layer ) ? mMaxHealth - layer * mLayerHealth : mLayerHealth;
+                ghost = ( ghost < 0 ) ? 0 : ( ( ghost > capacity ) ? capacity : ghost );
+
+            }
+            DrawGaugeReference( rImagePtr, y, GAUGE_HEALTH, layer, BarFill( health, capacity, mGaugeWidth ),
+                                BarFill( ghost, capacity, mGaugeWidth ), GaugeVariant( GAUGE_HEALTH ) );
+            if( 0 < mLayerHealth )
+            {
+
+                DrawNumber( rImagePtr, y, ( 0 < health ) ? layer + 1 : 0, NumberVariant( GAUGE_HEALTH ) );
+
+            }
+            else
+            {
+
+                DrawNumber( rImagePtr, y, GaugeNumber( health, mMaxHealth, false ), NumberVariant( GAUGE_HEALTH ) );
+
+            }
+
+        }
+        if( Shows( GAUGE_MANA ) )
+        {
+
+            y -= GAUGE_HEIGHT;
+            DrawGaugeReference( rImagePtr, y, GAUGE_MANA, 0, BarFill( mShownMana >> FIXED_SHIFT, mMaxMana, mGaugeWidth ), 0,
+                                GaugeVariant( GAUGE_MANA ) );
+            DrawNumber( rImagePtr, y, GaugeNumber( mShownMana >> FIXED_SHIFT, mMaxMana, false ), NumberVariant( GAUGE_MANA ) );
+
+        }
+        if( Shows( GAUGE_ATB ) )
+        {
+
+            y -= GAUGE_HEIGHT;
+            DrawGaugeReference( rImagePtr, y, GAUGE_ATB, 0, BarFill( mCurATB, ATB_MAX, mGaugeWidth ), 0, GaugeVariant( GAUGE_ATB ) );
+            DrawNumber( rImagePtr, y, GaugeNumber( mCurATB, ATB_MAX, true ), NumberVariant( GAUGE_ATB ) );
+
+        }
+        if( Shows( ELEMENT_ICONS ) )
+        {
+
+            y -= ICON_STRIP_HEIGHT;
+            DrawIcons( rImagePtr, y, VisibleConditions(), mShowCounters ? mConditionTurns : NULL );
+
+        }
+
+    }
+
+    //! Draws a gauge from scratch
+    /*!
+        DrawGaugeReference() is the reference version of DrawGaugeFast(): it works out every pixel
+        of the gauge from the frame and bar rectangles in the SystemGraphic, stretching their
+        middle part to the gauge width itself, and colors it for the layer tint and the color
+        variant.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the destination Image
+        \param rY : (int) Y coordinate of the gauge
+        \param rGauge : (int) Index of the gauge (GAUGE_HEALTH, GAUGE_MANA or GAUGE_ATB)
+        \param rLayer : (int) Layer of the bar; the layer below shows through as a full bar
+        \param rFill : (int) Width of the filled part of the bar
+        \param rGhostFill : (int) Width up to which the damage ghost is drawn (no ghost if not more than rFill)
+        \param rVariant : (int) Color variant of the gauge
+    */
+    void DrawGaugeReference( RPG::Image * rImagePtr, int rY, int rGauge, int rLayer, int rFill, int rGhostFill, int rVariant )
+    {
+
+        // Coordinates of the frame and the two bars of each gauge in the SystemGraphic
+        const static int FRAME_SRC[NUM_GAUGES][2] = { { HEALTH_GAUGE_SRC_X, HEALTH_GAUGE_SRC_Y },
+                                                      { MANA_GAUGE_SRC_X, MANA_GAUGE_SRC_Y },
+                                                      { ATB_GAUGE_SRC_X, ATB_GAUGE_SRC_Y } };
+        const static int BAR_A_SRC[NUM_GAUGES][2] = { { HEALTH_BAR_A_SRC_X, HEALTH_BAR_A_SRC_Y },
+                                                      { MANA_BAR_A_SRC_X, MANA_BAR_A_SRC_Y },
+                                                      { ATB_BAR_A_SRC_X, ATB_BAR_A_SRC_Y } };
+        const static int BAR_B_SRC[NUM_GAUGES][2] = { { HEALTH_BAR_B_SRC_X, HEALTH_BAR_B_SRC_Y },
+                                                      { MANA_BAR_B_SRC_X, MANA_BAR_B_SRC_Y },
+                                                      { ATB_BAR_B_SRC_X, ATB_BAR_B_SRC_Y } };
+
+        RPG::Image * systemPtr; // SystemGraphic
+        const int * barPtr;     // Coordinates of the bar drawn at the current pixel (NULL = none)
+        int row, col;           // Index variables
+        int src;                // Column in the SystemGraphic rectangles for the current column
+        unsigned char pixel;    // Color of the current pixel
+        unsigned char barPixel; // Color of a bar at the current pixel
+
+        systemPtr = RPG::system->systemGraphic->system2Image;
+        for( row = 0; row < GAUGE_HEIGHT; row++ )
+        {
+
+            for( col = 0; col < mGaugeWidth; col++ )
+            {
+
+                // The corners and edges are kept, the middle part is repeated
+                if( SLICE_BORDER > col )
+                {
+
+                    src = col;
+
+                }
+                else if( mGaugeWidth - SLICE_BORDER <= col )
+                {
+
+                    src = GAUGE_WIDTH - mGaugeWidth + col;
+
+                }
+                else
+                {
+
+                    src = SLICE_BORDER + ( col - SLICE_BORDER ) % ( GAUGE_WIDTH - 2 * SLICE_BORDER );
+
+                }
+                pixel = systemPtr->pixels[( FRAME_SRC[rGauge][1] + row ) * systemPtr->width + FRAME_SRC[rGauge][0] + src];
+                pixel = mReferenceColor[0][rVariant][pixel];
+                if( 0 < rLayer )
+                {
+
+                    barPixel = systemPtr->pixels[( BAR_B_SRC[rGauge][1] + row ) * systemPtr->width + BAR_B_SRC[rGauge][0] + src];
+                    if( 0 != barPixel )
+                    {
+
+                        pixel = mReferenceColor[( rLayer - 1 ) % NUM_LAYER_TINTS][rVariant][barPixel];
+
+                    }
+
+                }
+                if( rFill > col )
+                {
+
+                    barPtr = ( mGaugeWidth == rFill ) ? BAR_B_SRC[rGauge] : BAR_A_SRC[rGauge];
+
+                }
+                else
+                {
+
+                    barPtr = ( rGhostFill > col ) ? BAR_B_SRC[rGauge] : NULL;
+
+                }
+                if( NULL != barPtr )
+                {
+
+                    barPixel = systemPtr->pixels[( barPtr[1] + row ) * systemPtr->width + barPtr[0] + src];
+                    if( 0 != barPixel )
+                    {
+
+                        pixel = mReferenceColor[rLayer % NUM_LAYER_TINTS][rVariant][barPixel];
+
+                    }
+
+                }
+                rImagePtr->pixels[( rY + row ) * rImagePtr->width + col] = pixel;
+
+            }
+
+        }
+
+    }
+
+    //! Works out the colors of the reference renderer
+    /*!
+        BuildReferenceColors() computes, for every color of the SystemGraphic, the color the
+        reference renderer draws for each boss layer tint and color variant. It does the same
+        color math as BuildRemapTables(), written out one color at a time, so a mistake in the
+        remap tables shows up in the golden-image test instead of being copied into the
+        reference.
+    */
+    static void BuildReferenceColors()
+    {
+
+        const int * palettePtr; // Palette of the SystemGraphic
+        int tint, variant, i;   // Index variables
+        int tinted;             // Palette index of the color in the tint
+
+        palettePtr = RPG::system->systemGraphic->system2Image->palette;
+        for( tint = 0; tint < NUM_LAYER_TINTS; tint++ )
+        {
+
+            for( variant = 0; variant < NUM_VARIANTS; variant++ )
+            {
+
+                mReferenceColor[tint][variant][0] = 0;
+                for( i = 1; i < 256; i++ )
+                {
+
+                    tinted = ( 0 == tint ) ? i : ReferenceNearest( palettePtr, TintColor( palettePtr[i], tint ) );
+                    mReferenceColor[tint][variant][i] = static_cast<unsigned char>(
+                        ( VARIANT_NORMAL == variant ) ? tinted : ReferenceNearest( palettePtr, VariantColor( palettePtr[tinted], variant ) ) );
+
+                }
+
+            }
+
+        }
+        mReferenceReady = true;
 
     }
 
-    //! Destructor
+    //! Gets a color in a boss layer tint
     /*!
-        The destructor of BattleDisplay deletes all member objects and the BattleDisplay object
-        itself.
+        \param rColor : (int) Color in 0x00RRGGBB format
+        \param rTint : (int) Layer tint, 1 to NUM_LAYER_TINTS - 1
+        \return (int) The color with its components moved: tint 1 turns red into green, tint 2
+                 red into blue, tint 3 swaps red and blue
     */
-    ~BattleDisplay()
+    static int TintColor( int rColor, int rTint )
     {
 
-        // Destroy the image used to display battle info
-        RPG::Image::destroy( mDisplayPtr );
-        // Note that since mBattlerPtr merely points to a Battler object which exists outside of
-        // the context of this plugin, it does not have to (nor should it) be deleted/destroyed.
+        int r, g, b;            // Components of the color
+
+        r = ( rColor >> 16 ) & 0xFF;
+        g = ( rColor >> 8 ) & 0xFF;
+        b = rColor & 0xFF;
+        switch( rTint )
+        {
+
+        case 1:
+            return ( b << 16 ) | ( r << 8 ) | g;
+        case 2:
+            return ( g << 16 ) | ( b << 8 ) | r;
+        default:
+            return ( b << 16 ) | ( g << 8 ) | r;
+
+        }
 
     }
 
-    //! Sets the Battler
+    //! Gets a color in a color variant
     /*!
-        SetBattler() sets the value of mBattlerPtr to the given parameter and initializes related
-        variables according to the Battler's data.
-
-        \param rBattlerPtr : (RPG::Battler *) Pointer to the Battler which this BattleDisplay will serve
+        \param rColor : (int) Color in 0x00RRGGBB format
+        \param rVariant : (int) Color variant other than VARIANT_NORMAL
+        \return (int) The color reddened, greyed or brightened
     */
-    void SetBattler( RPG::Battler * rBattlerPtr )
+    static int VariantColor( int rColor, int rVariant )
     {
 
-        // If necessary, initialize static members
-        if( !mInitialized )
+        int r, g, b;            // Components of the color
+        int grey;               // Brightness of the color
+
+        r = ( rColor >> 16 ) & 0xFF;
+        g = ( rColor >> 8 ) & 0xFF;
+        b = rColor & 0xFF;
+        grey = ( r * 77 + g * 151 + b * 28 ) >> 8;
+        switch( rVariant )
         {
 
-            InitializeStatic();
+        case VARIANT_LOW:
+            return ( ( grey / 2 + 128 ) << 16 ) | ( ( grey / 4 ) << 8 ) | ( grey / 4 );
+        case VARIANT_GREY:
+            return ( grey << 16 ) | ( grey << 8 ) | grey;
+        default:
+            return ( ( ( r + 255 ) / 2 ) << 16 ) | ( ( ( g + 255 ) / 2 ) << 8 ) | ( ( b + 255 ) / 2 );
 
         }
-        // Initialize variables
-        mBattlerPtr = rBattlerPtr;
-        mCurHealth = rBattlerPtr->hp;
-        mCurMana = mBattlerPtr->mp;
-        mCurATB = mBattlerPtr->atbValue;
 
     }
 
-    //! Updates the BattleDisplay
+    //! Finds the palette color closest to a color, for the reference renderer
     /*!
-        Update() recalculates values based on past and present data and calls Draw() to refresh the
-        appearance of the BattleDisplay.
+        \param rPalettePtr : (const int *) Palette of 256 colors in 0x00RRGGBB format
+        \param rColor : (int) Color in 0x00RRGGBB format
+        \return (int) Lowest index of the closest colors, never the transparent index 0
     */
-    void Update()
+    static int ReferenceNearest( const int * rPalettePtr, int rColor )
     {
 
-        // Update variables
-        mCurHealth = mBattlerPtr->hp;
-        mCurMana = mBattlerPtr->mp;
-        mCurATB = mBattlerPtr->atbValue;
-        // Refresh display
-        Draw();
+        int j;                  // Index variable
+        int r, g, b;            // Differences of the components of the current candidate
+        int distance, best;     // Squared distance to the current and the best candidate
+        int index;              // Index of the best candidate
 
-    }
+        best = 3 * 256 * 256;
+        index = 255;
+        for( j = 255; 0 < j; j-- )
+        {
 
-private:
+            r = ( ( rPalettePtr[j] >> 16 ) & 0xFF ) - ( ( rColor >> 16 ) & 0xFF );
+            g = ( ( rPalettePtr[j] >> 8 ) & 0xFF ) - ( ( rColor >> 8 ) & 0xFF );
+            b = ( rPalettePtr[j] & 0xFF ) - ( rColor & 0xFF );
+            distance = r * r + g * g + b * b;
+            if( distance <= best )
+            {
 
-    static bool mInitialized;                           //!< Flag indicating whether the static members of the class have been initialized
+                best = distance;
+                index = j;
 
-    int mCurHealth;                                     //!< Current health
-    int mCurMana;                                       //!< Current mana
-    int mCurATB;                                        //!< Current ATB fill value
+            }
 
-    RPG::Image * mDisplayPtr;                           //!< Pointer to display Image
-    RPG::Battler * mBattlerPtr;                         //!< Pointer to Battler for which this BattleDisplay is used
+        }
+        return index;
 
-    //! Initializes static member variables
+    }
+
+    //! Draws a gauge number from scratch
     /*!
-        This method initializes the static member variables of the class. It should be called
-        before any instances of the class are created.
+        DrawNumber() is the reference version of the number drawing in RefreshGauge(): it draws
+        one half-size digit at a time, from the right, taking each digit from the right half of
+        its "0d" glyph, then recolors the whole number area to the color variant.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the destination Image
+        \param rY : (int) Y coordinate of the gauge
+        \param rNumber : (int) Number to draw (-1 = none)
+        \param rVariant : (int) Color variant of the number
     */
-    static void InitializeStatic()
+    void DrawNumber( RPG::Image * rImagePtr, int rY, int rNumber, int rVariant )
     {
 
-        int i;          // Index variable
+        int x;                  // X coordinate of the current digit
+        int row;                // Index variable
+        unsigned char * pixelPtr;       // Current pixel of the number area
 
-        // Initialize images
-        mHealthGaugePtr->draw( 0, 0,                                            // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               HEALTH_GAUGE_SRC_X, HEALTH_GAUGE_SRC_Y,          // Coordinates in source Image
-                               GAUGE_WIDTH, GAUGE_HEIGHT,                       // Dimensions in source Image
-                               0);                                              // Transparency color
-        mManaGaugePtr->draw( 0, 0,                                              // Coordinates in destination Image
-                             RPG::system->systemGraphic->system2Image,          // Source Image pointer
-                             MANA_GAUGE_SRC_X, MANA_GAUGE_SRC_Y,                // Coordinates in source Image
-                             GAUGE_WIDTH, GAUGE_HEIGHT,                         // Dimensions in source Image
-                             0);                                                // Transparency color
-        mATBGaugePtr->draw( 0, 0,                                               // Coordinates in destination Image
-                            RPG::system->systemGraphic->system2Image,           // Source Image pointer
-                            ATB_GAUGE_SRC_X, ATB_GAUGE_SRC_Y,                   // Coordinates in source Image
-                            GAUGE_WIDTH, GAUGE_HEIGHT,                          // Dimensions in source Image
-                            0);                                                 // Transparency color
-        mHealthBarAPtr->draw( 0, 0,                                             // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               HEALTH_BAR_A_SRC_X, HEALTH_BAR_A_SRC_Y,          // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        mManaBarAPtr->draw( 0, 0,                                               // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               MANA_BAR_A_SRC_X, MANA_BAR_A_SRC_Y,              // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        mATBBarAPtr->draw( 0, 0,                                                // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               ATB_BAR_A_SRC_X, ATB_BAR_A_SRC_Y,                // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        mHealthBarBPtr->draw( 0, 0,                                             // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               HEALTH_BAR_B_SRC_X, HEALTH_BAR_B_SRC_Y,          // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        mManaBarBPtr->draw( 0, 0,                                               // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               MANA_BAR_B_SRC_X, MANA_BAR_B_SRC_Y,              // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        mATBBarBPtr->draw( 0, 0,                                                // Coordinates in destination Image
-                               RPG::system->systemGraphic->system2Image,        // Source Image pointer
-                               ATB_BAR_B_SRC_X, ATB_BAR_B_SRC_Y,                // Coordinates in source Image
-                               BAR_WIDTH, BAR_HEIGHT,                           // Dimensions in source Image
-                               0);                                              // Transparency color
-        for( i = 0; i < NUM_DIGITS; i++ )
+        if( 0 > rNumber )
         {
 
-            mDigitPtr[i]->draw( 0, 0,                                           // Coordinates in destination Image
-                                   RPG::system->systemGraphic->system2Image,    // Source Image pointer
-                                   DIGIT_SRC_X + DIGIT_WIDTH * i, DIGIT_SRC_Y,  // Coordinates in source Image
-                                   DIGIT_WIDTH, DIGIT_HEIGHT,                   // Dimensions in source Image
-                                   0);                                          // Transparency color
+            return;
+
+        }
+        x = DISPLAY_WIDTH;
+        do
+        {
+
+            x -= COUNTER_SIZE / 2;
+            rImagePtr->draw( x, rY, mCounterPtr[ZERO_PAIR_GLYPH + rNumber % 10], COUNTER_SIZE / 2, 0, COUNTER_SIZE / 2, COUNTER_SIZE, 0 );
+            rNumber /= 10;
+
+        } while( 0 < rNumber );
+        for( row = 0; row < COUNTER_SIZE; row++ )
+        {
+
+            for( pixelPtr = rImagePtr->pixels + ( rY + row ) * rImagePtr->width + NUMBER_X;
+                 pixelPtr < rImagePtr->pixels + ( rY + row ) * rImagePtr->width + DISPLAY_WIDTH; pixelPtr++ )
+            {
+
+                *pixelPtr = mReferenceColor[0][rVariant][*pixelPtr];
+
+            }
 
         }
-        // Turn on initialized flag
-        mInitialized = true;
 
     }
 
-    //! Draws the display image
+    //! Compares the display Image to another Image
     /*!
-        This method draws the display Image based on the relevant data and display rules and puts
-        it on the Canvas.
+        Matches() compares the pixels of the display Image to those of another Image of the same
+        size byte-for-byte.
+
+        \param rImagePtr : (RPG::Image *) Pointer to the Image to compare with
+        \return (bool) true if all pixels are identical
     */
-    void Draw()
+    bool Matches( RPG::Image * rImagePtr )
+    {
+
+        return 0 == memcmp( mDisplayPtr->pixels, rImagePtr->pixels, DISPLAY_WIDTH * DISPLAY_HEIGHT );
+
+    }
+
+    //! Checks the display Image against a full redraw
+    /*!
+        VerifyShadow() renders the current values with the reference renderer and compares the
+        result to the incrementally drawn display Image. A mismatch is logged to
+        DynGauge_shadow.txt and the display is invalidated, so the error does not stay on screen.
+    */
+    template <class Policy>
+    void VerifyShadow()
     {
 
-        static int curX, curY;                  // Current coordinates within the display Image
+        if( NULL == mShadowPtr )
+        {
+
+            mShadowPtr = RPG::Image::create( DISPLAY_WIDTH, DISPLAY_HEIGHT );
+
+        }
+        DrawReference( mShadowPtr );
+        if( !Matches( mShadowPtr ) )
+        {
+
+            std::ofstream log( "DynGauge_shadow.txt", std::ios::app );    // Log file
 
-        // Clear the display Image
-        mDisplayPtr->clear();
-        // Find starting position: lower-left corner of display Image with enough room for one gauge
-        curX = 0;
-        curY = DISPLAY_HEIGHT - GAUGE_HEIGHT;
-        // Draw the health gauge
-        mDisplayPtr->draw( curX, curY,                                          // Coordinates in destination Image
-                           mHealthGaugePtr,                                     // Source Image pointer
-                           0, 0,                                                // Coordinates in source Image
-                           GAUGE_WIDTH, GAUGE_HEIGHT,                           // Dimensions in source Image
-                           0);
+            log << "Frame " << mFrameCount << ": mismatch for "
+                << Policy::Name() << " " << mBattlerPtr->id
+                << " hp=" << ( mShownHealth >> FIXED_SHIFT ) << "/" << mMaxHealth
+                << " mp=" << ( mShownMana >> FIXED_SHIFT ) << "/" << mMaxMana
+                << " atb=" << mCurATB << std::endl;
+            Invalidate();
+            Draw<Policy>();
+
+        }
 
     }
 
 };
 
 bool BattleDisplay::mInitialized = false;
+int BattleDisplay::mFrameCount = 0;
+int BattleDisplay::mAnimationRate = 1 << BattleDisplay::RATE_SHIFT;
+int BattleDisplay::mGhostDelay = 0;
+TimerWheel BattleDisplay::mTimerWheel;
+char BattleDisplay::mIconSetFile[BattleDisplay::MAX_PATH_LENGTH];
+int BattleDisplay::mBlinkInterval = 0;
+bool BattleDisplay::mShowCounters = true;
+RPG::Image * BattleDisplay::mCounterPtr[BattleDisplay::NUM_PAIR_GLYPHS] = { NULL };
+Sprite BattleDisplay::mGaugeSprite[BattleDisplay::NUM_GAUGES];
+Sprite BattleDisplay::mBarASprite[BattleDisplay::NUM_GAUGES];
+Sprite BattleDisplay::mBarBSprite[BattleDisplay::NUM_GAUGES];
+Sprite BattleDisplay::mDigitSprite[BattleDisplay::NUM_DIGITS];
+Sprite BattleDisplay::mIconSprite[BattleDisplay::MAX_CONDITIONS];
+Sprite BattleDisplay::mCounterSprite[BattleDisplay::NUM_PAIR_GLYPHS];
+RPG::Image * BattleDisplay::mIconSetPtr = NULL;
+bool BattleDisplay::mShowElement[BattleDisplay::NUM_ELEMENTS] = { true, true, true, true };
+int BattleDisplay::mLayoutVersion = 0;
+int BattleDisplay::mShadowInterval = 0;
+int BattleDisplay::mNextShadowPhase = 0;
+bool BattleDisplay::mGoldenTest = false;
+char BattleDisplay::mGoldenDirectory[BattleDisplay::MAX_PATH_LENGTH];
+bool BattleDisplay::mBenchmark = false;
+bool BattleDisplay::mAutoTune = false;
+bool BattleDisplay::mTuned = false;
+char BattleDisplay::mTuneFile[BattleDisplay::MAX_PATH_LENGTH];
+bool BattleDisplay::mMemoryReport = false;
+int BattleDisplay::mMemoryBudget = 0;
+int BattleDisplay::mEvictedBytes = 0;
+bool BattleDisplay::mIconSetEvicted = false;
+int BattleDisplay::mPopupFrames = 0;
+bool BattleDisplay::mPopupHeals = true;
+bool BattleDisplay::mShowNumbers = false;
+unsigned char BattleDisplay::mInnerPairGlyph[100];
+unsigned char BattleDisplay::mRemap[BattleDisplay::NUM_VARIANTS][256];
+unsigned char BattleDisplay::mLayerRemap[BattleDisplay::NUM_LAYER_TINTS][256];
+unsigned char BattleDisplay::mReferenceColor[BattleDisplay::NUM_LAYER_TINTS][BattleDisplay::NUM_VARIANTS][256];
+bool BattleDisplay::mReferenceReady = false;
+unsigned char BattleDisplay::mMonsterSlot[BattleDisplay::MAX_MONSTER_ID + 1];
+BattleDisplay::MonsterSettings BattleDisplay::mMonsterSettings[BattleDisplay::MAX_MONSTER_SETTINGS] = { { 0, 0, 0, 1, BattleDisplay::ALL_ELEMENTS } };
+int BattleDisplay::mNumMonsterSettings = 1;
+int BattleDisplay::mBossLayers = 5;
+int BattleDisplay::mLowHealthPercent = 25;
+bool BattleDisplay::mFlashOnHit = true;
+int BattleDisplay::mPanelOpacity = 0;
+int BattleDisplay::mPanelColor = 0;
+int BattleDisplay::mGaugeWidthSetting = BattleDisplay::GAUGE_WIDTH;
+int BattleDisplay::mHealthPerPixel = 0;
+bool BattleDisplay::mAnchorToSprite = true;
+bool BattleDisplay::mAnchorsChecked = false;
+BattleDisplay::GaugeFrames BattleDisplay::mFrames[BattleDisplay::MAX_FRAMES];
+int BattleDisplay::mNumFrames = 0;
+bool BattleDisplay::mPopupEachChange = false;
+BattleDisplay::Popup BattleDisplay::mPopup[BattleDisplay::MAX_POPUPS];
+int BattleDisplay::mNextPopup = 0;
+RPG::Image * BattleDisplay::mShadowPtr = NULL;
+RPG::Image * BattleDisplay::mPanelPtr = NULL;
+ImageArena BattleDisplay::mBattleArena;
 RPG::Image * BattleDisplay::mHealthGaugePtr = RPG::Image::create( BattleDisplay::GAUGE_WIDTH, BattleDisplay::GAUGE_HEIGHT );
 RPG::Image * BattleDisplay::mManaGaugePtr = RPG::Image::create( BattleDisplay::GAUGE_WIDTH, BattleDisplay::GAUGE_HEIGHT );
 RPG::Image * BattleDisplay::mATBGaugePtr = RPG::Image::create( BattleDisplay::GAUGE_WIDTH, BattleDisplay::GAUGE_HEIGHT );
@@ -290,7 +6346,6 @@ RPG::Image * BattleDisplay::mDigitPtr[BattleDisplay::NUM_DIGITS] = {
 const int NUM_HEROES = 4;                               //!< Maximum number of heroes
 const int NUM_MONSTERS = 8;                             //!< Maximum number of monsters
 
-std::map<std::string, std::string> configuration;       //!< Configuration data from the DynRPG.ini file
 
 
 bool inBattle;                                          //!< Whether the game is currently in a battle
@@ -302,10 +6357,12 @@ bool onStartup( char *pluginName )
 {
 
     int i;          // Index variable
+    std::map<std::string, std::string> configuration;   // Configuration data from the DynRPG.ini file; only needed here
 
     // Initialize variables
     inBattle = false;
 	configuration = RPG::loadConfiguration( pluginName );
+    BattleDisplay::Configure( configuration );
 
 	return true;
 
@@ -323,6 +6380,7 @@ void onFrame( RPG::Scene scene )
 
     static int i;           // Index variable
 
+    BattleDisplay::Tick();
     if( inBattle )
     {   // Game was in a battle scene at last check
 
@@ -330,6 +6388,10 @@ void onFrame( RPG::Scene scene )
         {   // Current scene is not a battle; battle just ended!
 
             inBattle = false;
+            BattleDisplay::EndBattle( heroBattleDisplay, NUM_HEROES );
+            BattleDisplay::EndBattle( monsterBattleDisplay, NUM_MONSTERS );
+            BattleDisplay::mBattleArena.Reset();
+            BattleDisplay::OnBattleEnd();
 
         }
 
@@ -342,52 +6404,201 @@ void onFrame( RPG::Scene scene )
 
             inBattle = true;
             // Assign BattleDisplays for all active Battlers
+            for( i = 0; i < NUM_HEROES; i++ )
+            {
+
+                if( NULL != RPG::Actor::partyMember( i ) )
+                {
+
+                    heroBattleDisplay[i].SetBattler<BattleDisplay::HeroPolicy>( RPG::Actor::partyMember( i ) );
+
+                }
+                else
+                {
+
+                    heroBattleDisplay[i].Release();
+
+                }
+
+            }
             for( i = 0; i < NUM_MONSTERS; i++ )
             {
 
                 if( 0 != RPG::monsters[i]->databaseId )
                 {
 
-                    monsterBattleDisplay[i].SetBattler( RPG::monsters[i] );
+                    monsterBattleDisplay[i].SetBattler<BattleDisplay::MonsterPolicy>( RPG::monsters[i] );
+
+                }
+                else
+                {
+
+                    monsterBattleDisplay[i].Release();
 
                 }
 
             }
+            BattleDisplay::CheckAnchors( monsterBattleDisplay, NUM_MONSTERS );
+            // Pick the blit kernels, then run the self-tests now that the SystemGraphic is
+            // available, so the golden-image test checks the kernels actually in use
+            BattleDisplay::AutoTune();
+            BattleDisplay::RunGoldenTest();
+            BattleDisplay::RunBenchmark();
 
         }
 
     }
+    if( inBattle )
+    {   // Each side is updated by its own loop, specialized for its policy; the displays and
+        // their popups are put on the Canvas by onBattlerDrawn(), so they are aged here
+
+        BattleDisplay::UpdateAll<BattleDisplay::HeroPolicy>( heroBattleDisplay, NUM_HEROES );
+        BattleDisplay::UpdateAll<BattleDisplay::MonsterPolicy>( monsterBattleDisplay, NUM_MONSTERS );
+        BattleDisplay::AgePopups();
+
+    }
 
 }
 
 //! Called immediately after a Battler is drawn
 /*!
     onBattlerDrawn() is called immediately after a Battler is drawn to the Canvas. In this plugin
-    this method is used to update the BattleDisplays.
+    this method is used to put the Battler's BattleDisplay on the Canvas.
 
     \param battler : ( RPG::Battler * ) The battler which was drawn (or supposed to be drawn)
     \param isMonster: ( bool ) true if the battler is a monster
     \param id: ( int ) Zero-based party member ID of the battler
 */
-//bool onBattlerDrawn( RPG::Battler *battler, bool isMonster, int id )
-//{
-//
-//    // Call Update on appropriate BattleDisplay
-//    if( isMonster )
-//    {
-//
-//        monsterBattleDisplay[id].Update();
-//
-//    }
-//    else
-//    {
-//
-//        heroBattleDisplay[id].Update();
-//
-//    }
-//    return true;
-//
-//}
+bool onBattlerDrawn( RPG::Battler * /* battler */, bool isMonster, int id )
+{
+
+    // Show the appropriate BattleDisplay
+    if( isMonster )
+    {
+
+        if( 0 <= id && NUM_MONSTERS > id )
+        {
+
+            monsterBattleDisplay[id].Show<BattleDisplay::MonsterPolicy>();
+
+        }
+
+    }
+    else
+    {
+
+        if( 0 <= id && NUM_HEROES > id )
+        {
+
+            heroBattleDisplay[id].Show<BattleDisplay::HeroPolicy>();
+
+        }
+
+    }
+    return true;
+
+}
+
+//! Called before a Battler acts
+/*!
+    onDoBattlerAction() is called before a Battler does an action. In this plugin this method is
+    used to count the turns of the Battler's status conditions.
+
+    \param battler : ( RPG::Battler * ) The battler which is about to act
+    \param firstTry : ( bool ) true if this is the first call for this action
+*/
+bool onDoBattlerAction( RPG::Battler *battler, bool firstTry )
+{
+
+    int i;          // Index variable
+
+    if( !firstTry )
+    {
+
+        return true;
+
+    }
+    for( i = 0; i < NUM_HEROES; i++ )
+    {
+
+        if( heroBattleDisplay[i].Serves( battler ) )
+        {
+
+            heroBattleDisplay[i].OnTurn();
+            return true;
+
+        }
+
+    }
+    for( i = 0; i < NUM_MONSTERS; i++ )
+    {
+
+        if( monsterBattleDisplay[i].Serves( battler ) )
+        {
+
+            monsterBattleDisplay[i].OnTurn();
+            return true;
+
+        }
+
+    }
+    return true;
+
+}
+
+//! Called after a Battler acted
+/*!
+    onBattlerActionDone() is called after a Battler finished an action. In this plugin this method
+    is used to record the HP changes the action caused, so several actions within one frame can
+    still be told apart; the BattleDisplays apply them together in the next frame.
+
+    \param battler : ( RPG::Battler * ) The battler which acted
+    \param success : ( bool ) true if the action was successful
+*/
+bool onBattlerActionDone( RPG::Battler * /* battler */, bool /* success */ )
+{
+
+    if( inBattle )
+    {
+
+        BattleDisplay::ObserveAll( heroBattleDisplay, NUM_HEROES );
+        BattleDisplay::ObserveAll( monsterBattleDisplay, NUM_MONSTERS );
+
+    }
+    return true;
+
+}
+
+//! Called when a comment is reached in an event
+/*!
+    onComment() is called when an event script reaches a comment. In this plugin it handles the
+    comment command @DynGauge_MemoryReport, which writes the memory report on demand.
+
+    \param text : ( const char * ) Text of the comment
+    \param parsedData : ( const RPG::ParsedCommentData * ) Parsed comment data
+    \param nextScriptLine : ( RPG::EventScriptLine * ) The script line after the comment
+    \param scriptData : ( RPG::EventScriptData * ) Script data of the event
+    \param eventId : ( int ) ID of the event
+    \param pageId : ( int ) ID of the event page
+    \param lineId : ( int ) Line number of the comment
+    \param nextLineId : ( int * ) Line number of the next line to execute
+    \return ( bool ) false if the comment was handled, so no other plugin gets it
+*/
+bool onComment( const char * /* text */, const RPG::ParsedCommentData *parsedData, RPG::EventScriptLine * /* nextScriptLine */,
+                RPG::EventScriptData * /* scriptData */, int /* eventId */, int /* pageId */, int /* lineId */, int * /* nextLineId */ )
+{
+
+    // Command names are given in lower case
+    if( 0 == strcmp( parsedData->command, "dyngauge_memoryreport" ) )
+    {
+
+        BattleDisplay::WriteMemoryReport( "comment" );
+        return false;
+
+    }
+    return true;
+
+}
 
 //! Clean up after use
 /*!
@@ -399,7 +6610,10 @@ void onExit()
 
     int i;          // Index variable
 
-    // Destroy static Images of BattleDisplay class
+    BattleDisplay::ReportMemory( "exit" );
+    // Destroy static Images of BattleDisplay class, and the Images of the battle arena
+    BattleDisplay::mBattleArena.Destroy();
+    BattleDisplay::DestroyFrames();
     RPG::Image::destroy( BattleDisplay::mHealthGaugePtr );
     RPG::Image::destroy( BattleDisplay::mManaGaugePtr );
     RPG::Image::destroy( BattleDisplay::mATBGaugePtr );
@@ -415,5 +6629,34 @@ void onExit()
         RPG::Image::destroy( BattleDisplay::mDigitPtr[i] );
 
     }
+    if( NULL != BattleDisplay::mShadowPtr )
+    {
+
+        RPG::Image::destroy( BattleDisplay::mShadowPtr );
+
+    }
+    if( NULL != BattleDisplay::mPanelPtr )
+    {
+
+        RPG::Image::destroy( BattleDisplay::mPanelPtr );
+
+    }
+    if( NULL != BattleDisplay::mIconSetPtr )
+    {
+
+        RPG::Image::destroy( BattleDisplay::mIconSetPtr );
+
+    }
+    for( i = 0; i < BattleDisplay::NUM_PAIR_GLYPHS; i++ )
+    {
+
+        if( NULL != BattleDisplay::mCounterPtr[i] )
+        {
+
+            RPG::Image::destroy( BattleDisplay::mCounterPtr[i] );
+
+        }
+
+    }
 
 }